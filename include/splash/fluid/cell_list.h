@@ -0,0 +1,96 @@
+#ifndef SPLASH_FLUID_CELL_LIST_H_
+#define SPLASH_FLUID_CELL_LIST_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace splash
+{
+namespace fluid
+{
+// Particle indices grouped by cell, with free slots after each cell's particles.
+// When particles are assigned cells again, only the particles that changed cell are moved between lists,
+// unless too many changed, in which case the lists are rebuilt by counting sort.
+// A cell running out of free slots is moved to the end with twice the capacity.
+class CellList
+{
+public:
+  class Range
+  {
+  public:
+    Range(const uint32_t* begin, const uint32_t* end)
+      : begin_(begin), end_(end) {}
+
+    const uint32_t* begin() const noexcept { return begin_; }
+    const uint32_t* end() const noexcept { return end_; }
+    auto size() const noexcept { return static_cast<uint32_t>(end_ - begin_); }
+    bool empty() const noexcept { return begin_ == end_; }
+
+  private:
+    const uint32_t* begin_;
+    const uint32_t* end_;
+  };
+
+  CellList();
+  ~CellList();
+
+  void setMultiprocessing(bool flag)
+  {
+    multiprocessing_ = flag;
+  }
+
+  // Fraction of particles changing cell above which the lists are rebuilt
+  void setRebuildRatio(float ratio)
+  {
+    rebuildRatio_ = ratio;
+  }
+
+  // Assigns particle i to cell particleCells[i]. Returns true if the lists are rebuilt.
+  bool update(const std::vector<uint32_t>& particleCells, uint32_t cellCount);
+
+  // Forces the next update to rebuild, e.g. when cells are laid out differently
+  void invalidate()
+  {
+    valid_ = false;
+  }
+
+  auto cellCount() const noexcept { return static_cast<uint32_t>(cellSizes_.size()); }
+  auto movedCount() const noexcept { return movedCount_; } // Particles that changed cell in the last update
+
+  Range operator [] (uint32_t cell) const
+  {
+    const auto* begin = indices_.data() + cellStart_[cell];
+    return Range(begin, begin + cellSizes_[cell]);
+  }
+
+private:
+  // Counting sort, with particles of a cell in increasing index order
+  void rebuildMultiThreaded(const std::vector<uint32_t>& particleCells, uint32_t cellCount);
+  void rebuildSingleThreaded(const std::vector<uint32_t>& particleCells, uint32_t cellCount);
+
+  void moveChangedParticles(const std::vector<uint32_t>& particleCells);
+  void grow(uint32_t cell);
+
+  // Free slots of a cell with count particles
+  static uint32_t slack(uint32_t count) { return 1 + count / 4; }
+
+  bool multiprocessing_ = false;
+  float rebuildRatio_ = 0.1f;
+  bool valid_ = false;
+  uint32_t movedCount_ = 0;
+
+  std::vector<uint32_t> cellStart_; // Offsets to indices_
+  std::vector<uint32_t> cellSizes_;
+  std::vector<uint32_t> cellCapacities_;
+  uint32_t rebuiltSize_ = 0; // Size of indices_ when rebuilt, before cells grew
+  std::vector<std::atomic<uint32_t>> cellCounts_;
+  std::vector<uint32_t> indices_; // Particle indices by cell, with free slots
+  std::vector<uint32_t> particleCells_; // Cell of each particle as of the last update
+  std::vector<uint32_t> particleSlots_; // Offset to indices_ of each particle
+  std::vector<uint32_t> changed_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_CELL_LIST_H_
@@ -0,0 +1,82 @@
+#ifndef SPLASH_FLUID_CELL_TABLE_H_
+#define SPLASH_FLUID_CELL_TABLE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace splash
+{
+namespace fluid
+{
+// Open-addressing hash table from integer cell coordinates to dense cell ids, in insertion order.
+// Entries are probed linearly in a flat array of a power-of-two capacity, kept at most half full,
+// so lookups of distinct cells never share an entry and probe sequences stay short.
+class CellTable
+{
+public:
+  static constexpr uint32_t notFound = ~0u;
+
+  CellTable();
+  ~CellTable();
+
+  // Removes all cells, keeping room for cellCount cells
+  void clear(uint32_t cellCount = 0);
+
+  // Id of cell, or notFound
+  uint32_t find(const glm::ivec3& cell) const
+  {
+    if (cells_.empty())
+      return notFound;
+
+    for (auto slot = hash(cell) & mask_; ; slot = (slot + 1) & mask_)
+    {
+      const auto& entry = entries_[slot];
+      if (entry.id == notFound || entry.cell == cell)
+        return entry.id;
+    }
+  }
+
+  // Id of cell, inserted with the next id if not found
+  uint32_t insert(const glm::ivec3& cell);
+
+  auto size() const noexcept { return static_cast<uint32_t>(cells_.size()); }
+
+  // Ids are below capacity
+  auto capacity() const noexcept { return static_cast<uint32_t>(entries_.size()) / 2; }
+
+  const auto& operator [] (uint32_t id) const { return cells_[id]; }
+
+  // Fraction of cells not in the entry they hash to
+  float displacedRate() const;
+
+private:
+  struct Entry
+  {
+    glm::ivec3 cell;
+    uint32_t id;
+  };
+
+  static uint32_t hash(const glm::ivec3& cell)
+  {
+    // Murmur3 finalizer over the mixed coordinates, so that nearby cells spread over the table
+    uint32_t n = (73856093u * static_cast<uint32_t>(cell.x)) ^ (19349663u * static_cast<uint32_t>(cell.y)) ^ (83492791u * static_cast<uint32_t>(cell.z));
+    n ^= n >> 16;
+    n *= 0x85ebca6bu;
+    n ^= n >> 13;
+    n *= 0xc2b2ae35u;
+    n ^= n >> 16;
+    return n;
+  }
+
+  void rehash(uint32_t entryCount);
+
+  std::vector<Entry> entries_;
+  uint32_t mask_ = 0;
+  std::vector<glm::ivec3> cells_; // By id
+};
+}
+}
+
+#endif // SPLASH_FLUID_CELL_TABLE_H_
@@ -1,16 +0,0 @@
-#ifndef SPLASH_FLUID_NEIGHBOR_H_
-#define SPLASH_FLUID_NEIGHBOR_H_
-
-namespace splash
-{
-namespace fluid
-{
-struct Neighbor
-{
-  int i0;
-  int i1;
-};
-}
-}
-
-#endif // SPLASH_FLUID_NEIGHBOR_H_
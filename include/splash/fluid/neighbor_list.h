@@ -0,0 +1,85 @@
+#ifndef SPLASH_FLUID_NEIGHBOR_LIST_H_
+#define SPLASH_FLUID_NEIGHBOR_LIST_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace splash
+{
+namespace fluid
+{
+// Neighbor indices of all particles in compressed sparse row format.
+// Neighbors of particle i are indices()[offsets()[i]] to indices()[offsets()[i + 1] - 1].
+// A symmetric list stores each unordered pair once, under only one of the two particles.
+// Neighbors of each particle are partitioned into fluid neighbors first, then boundary neighbors.
+class NeighborList
+{
+public:
+  class Range
+  {
+  public:
+    Range(const uint32_t* begin, const uint32_t* end)
+      : begin_(begin), end_(end) {}
+
+    const uint32_t* begin() const noexcept { return begin_; }
+    const uint32_t* end() const noexcept { return end_; }
+    auto size() const noexcept { return static_cast<uint32_t>(end_ - begin_); }
+    bool empty() const noexcept { return begin_ == end_; }
+
+  private:
+    const uint32_t* begin_;
+    const uint32_t* end_;
+  };
+
+  NeighborList() = default;
+  ~NeighborList() = default;
+
+  auto particleCount() const noexcept { return offsets_.empty() ? 0u : static_cast<uint32_t>(offsets_.size() - 1); }
+  auto neighborCount() const noexcept { return static_cast<uint32_t>(indices_.size()); }
+
+  bool symmetric() const noexcept { return symmetric_; }
+  void setSymmetric(bool flag) noexcept { symmetric_ = flag; }
+
+  const auto& offsets() const noexcept { return offsets_; }
+  auto& offsets() noexcept { return offsets_; }
+  const auto& indices() const noexcept { return indices_; }
+  auto& indices() noexcept { return indices_; }
+  const auto& splits() const noexcept { return splits_; }
+  auto& splits() noexcept { return splits_; }
+
+  Range operator [] (int index) const
+  {
+    const auto* data = indices_.data();
+    return Range(data + offsets_[index], data + offsets_[index + 1]);
+  }
+
+  Range fluid(int index) const
+  {
+    const auto* data = indices_.data();
+    return Range(data + offsets_[index], data + splits_[index]);
+  }
+
+  Range boundary(int index) const
+  {
+    const auto* data = indices_.data();
+    return Range(data + splits_[index], data + offsets_[index + 1]);
+  }
+
+  // Resets to n particles without neighbors
+  void reset(uint32_t n)
+  {
+    offsets_.assign(n + 1, 0);
+    splits_.assign(n, 0);
+    indices_.clear();
+  }
+
+private:
+  std::vector<uint32_t> offsets_; // Of size particle count + 1
+  std::vector<uint32_t> splits_; // Offsets of the first boundary neighbor of each particle
+  std::vector<uint32_t> indices_;
+  bool symmetric_ = false;
+};
+}
+}
+
+#endif // SPLASH_FLUID_NEIGHBOR_LIST_H_
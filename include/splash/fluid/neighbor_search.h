@@ -1,9 +1,13 @@
 #ifndef SPLASH_FLUID_NEIGHBOR_SEARCH_H_
 #define SPLASH_FLUID_NEIGHBOR_SEARCH_H_
 
+#include <chrono>
 #include <vector>
 
-#include <splash/fluid/neighbor.h>
+#include <glm/glm.hpp>
+
+#include <splash/fluid/neighbor_list.h>
+#include <splash/fluid/periodic_domain.h>
 
 namespace splash
 {
@@ -17,6 +21,26 @@ namespace fluid
 class NeighborSearch
 {
 public:
+  // Of the last computeNeighbors
+  struct Statistics
+  {
+    static constexpr int maxParticlesPerCell = 16;
+
+    double buildMilliseconds = 0.; // Spatial structure
+    double queryMilliseconds = 0.; // Neighbor enumeration and collection
+
+    // Only if statistics are enabled
+    uint64_t pairCount = 0; // Unordered pairs
+    uint32_t minNeighbors = 0;
+    float meanNeighbors = 0.f;
+    uint32_t maxNeighbors = 0;
+
+    // Only if statistics are enabled, and for cell-based searches
+    uint32_t occupiedCells = 0;
+    std::vector<uint32_t> particlesPerCell; // Count of occupied cells with k + 1 particles, the last with maxParticlesPerCell or more
+    float collisionRate = 0.f; // Fraction of hashed cells displaced from the table entry they hash to
+  };
+
   NeighborSearch();
   virtual ~NeighborSearch();
 
@@ -25,12 +49,127 @@ public:
     multiprocessing_ = flag;
   }
 
+  // Enumerate each unordered pair once, with a half stencil of 13 forward cells and the home cell
+  void setSymmetric(bool flag)
+  {
+    symmetric_ = flag;
+  }
+
+  // Boundary particles are queried for neighbors, and boundary-boundary pairs are kept, only if enabled.
+  // Needed when boundary volumes are computed from boundary neighbors.
+  void setBoundaryNeighbors(bool flag)
+  {
+    boundaryNeighbors_ = flag;
+  }
+
+  // Pairs across periodic boundaries, at minimum image distance. Ignored unless supportsPeriodicDomain().
+  void setPeriodicDomain(const PeriodicDomain& domain)
+  {
+    domain_ = domain;
+  }
+
+  const PeriodicDomain& periodicDomain() const noexcept { return domain_; }
+
+  virtual bool supportsPeriodicDomain() const { return false; }
+
+  // Verlet lists: neighbors are searched within h + skin, and reused until a particle moves more than skin / 2
+  void setSkin(float skin)
+  {
+    skin_ = skin;
+  }
+
+  float skin() const noexcept { return skin_; }
+
+  // Recomputes neighbors within h + skin only when the last lists may have missed a pair within h.
+  // Returns true if neighbors are recomputed.
+  bool updateNeighbors(const geom::Particles& particles, float h);
+
+  // Forces the next updateNeighbors to recompute, e.g. when particles are reordered
+  void invalidate()
+  {
+    valid_ = false;
+  }
+
+  // Counting pairs and cell occupancy costs an extra pass, so it is off by default
+  void setStatisticsEnabled(bool flag)
+  {
+    statisticsEnabled_ = flag;
+  }
+
+  const Statistics& statistics() const noexcept { return statistics_; }
+
   virtual void computeNeighbors(const geom::Particles& particles, float h) = 0;
-  const std::vector<Neighbor>& neighbors() const noexcept { return neighbors_; }
+
+  // Per-particle support radii, where particles i and j are neighbors within max(radii[i], radii[j]).
+  // By default, searches within the largest radius and filters.
+  virtual void computeVariableNeighbors(const geom::Particles& particles, const std::vector<float>& radii);
+
+  const NeighborList& neighbors() const noexcept { return neighbors_; }
+
+  // Point queries against the structure built by the last computeNeighbors, without rebuilding it.
+  // Particles are tested at their current positions, and may have moved by up to skin / 2 since the last build,
+  // as between rebuilds of updateNeighbors. Indices of each point are replaced, in parallel over points with multiprocessing.
+  void queryRadius(const geom::Particles& particles, const std::vector<glm::vec3>& points, float radius, std::vector<std::vector<uint32_t>>& indices) const;
+
+  // The k nearest particles of each point, by increasing distance, or all particles if fewer
+  void queryNearest(const geom::Particles& particles, const std::vector<glm::vec3>& points, int k, std::vector<std::vector<uint32_t>>& indices) const;
 
 protected:
+  // Appends indices of particles within radius of center. By default, tests all particles.
+  // Structures built from positions of the last build search within radius + queryMargin().
+  virtual void queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const;
+
+  // Appends indices of the k nearest particles, by increasing distance.
+  // By default, doubles a radius from searchRadius_ until k particles are within it.
+  virtual void queryNearestPoint(const geom::Particles& particles, const glm::vec3& center, int k, std::vector<uint32_t>& indices) const;
+
+  // Distance particles may have moved since the last build
+  float queryMargin() const;
+
+  // Appends indices of particles within radius of center, testing all particles
+  void queryAllParticles(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const;
+
+  // Keeps the k nearest of indices, by increasing distance
+  void keepNearest(const geom::Particles& particles, const glm::vec3& center, int k, std::vector<uint32_t>& indices) const;
+
+  // Timing of computeNeighbors, from startBuild to finishBuild and then to collectNeighbors
+  void startBuild();
+  void finishBuild();
+
+  // Whether particle i needs its neighbors. Symmetric pairs may be stored under boundary particles, so they are always queried.
+  bool queried(const geom::Particles& particles, int i) const;
+
+  // Partitions per-particle neighbor indices into fluid and boundary neighbors, and concatenates them into neighbors_
+  void collectNeighbors(const geom::Particles& particles, std::vector<std::vector<uint32_t>>& neighborsPerParticle);
+
+  void addOccupiedCell(uint32_t particleCount);
+
   bool multiprocessing_ = false;
-  std::vector<Neighbor> neighbors_;
+  bool symmetric_ = false;
+  bool statisticsEnabled_ = false;
+  bool boundaryNeighbors_ = true;
+  float searchRadius_ = 0.f; // Of the last build, from which nearest neighbor queries start
+  PeriodicDomain domain_;
+  NeighborList neighbors_;
+  Statistics statistics_;
+
+private:
+  float maxDisplacement(const geom::Particles& particles) const;
+  void computeNeighborStatistics();
+
+  std::chrono::high_resolution_clock::time_point buildStart_;
+  std::chrono::high_resolution_clock::time_point buildFinish_;
+  std::vector<uint32_t> neighborCounts_;
+  std::vector<uint32_t> fluidCounts_;
+
+  // Verlet lists
+  float skin_ = 0.f;
+  bool valid_ = false;
+  float lastH_ = 0.f;
+  float lastSkin_ = 0.f;
+  bool lastBoundaryNeighbors_ = true;
+  PeriodicDomain lastDomain_;
+  std::vector<glm::vec3> lastPositions_;
 };
 }
 }
@@ -0,0 +1,52 @@
+#ifndef SPLASH_FLUID_NEIGHBOR_SEARCH_BENCHMARK_H_
+#define SPLASH_FLUID_NEIGHBOR_SEARCH_BENCHMARK_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace splash
+{
+namespace geom
+{
+class Particles;
+}
+
+namespace fluid
+{
+class NeighborSearch;
+
+// Measures multithreaded neighbor search speedup against TBB thread count
+class NeighborSearchBenchmark
+{
+public:
+  struct Timing
+  {
+    int threads = 0;
+    double milliseconds = 0.;
+    double speedup = 1.;
+  };
+
+  NeighborSearchBenchmark();
+  ~NeighborSearchBenchmark();
+
+  void setRepeats(int repeats)
+  {
+    repeats_ = repeats;
+  }
+
+  // Runs computeNeighbors with 1, 2, 4, ... threads up to the available concurrency
+  void measureScaling(NeighborSearch& neighborSearch, const geom::Particles& particles, float h);
+
+  const auto& timings() const noexcept { return timings_; }
+
+  void printReport(std::ostream& out, const std::string& name) const;
+
+private:
+  int repeats_ = 5;
+  std::vector<Timing> timings_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_NEIGHBOR_SEARCH_BENCHMARK_H_
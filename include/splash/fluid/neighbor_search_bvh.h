@@ -0,0 +1,33 @@
+#ifndef SPLASH_FLUID_NEIGHBOR_SEARCH_BVH_H_
+#define SPLASH_FLUID_NEIGHBOR_SEARCH_BVH_H_
+
+#include <splash/fluid/neighbor_search.h>
+
+#include <splash/geom/particles_bvh.h>
+
+namespace splash
+{
+namespace fluid
+{
+// Fixed-radius queries on a linear BVH rebuilt every search.
+// Memory is proportional to the particle count only, so sparse scenes with large empty space stay cheap.
+class NeighborSearchBvh final : public NeighborSearch
+{
+public:
+  NeighborSearchBvh();
+  ~NeighborSearchBvh() override;
+
+  void computeNeighbors(const geom::Particles& particles, float h) override;
+
+protected:
+  void queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const override;
+  void queryNearestPoint(const geom::Particles& particles, const glm::vec3& center, int k, std::vector<uint32_t>& indices) const override;
+
+private:
+  geom::ParticlesBvh bvh_;
+  std::vector<std::vector<uint32_t>> neighborsPerParticle_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_NEIGHBOR_SEARCH_BVH_H_
@@ -0,0 +1,53 @@
+#ifndef SPLASH_FLUID_NEIGHBOR_SEARCH_MULTI_LEVEL_GRID_H_
+#define SPLASH_FLUID_NEIGHBOR_SEARCH_MULTI_LEVEL_GRID_H_
+
+#include <splash/fluid/neighbor_search.h>
+
+#include <glm/glm.hpp>
+
+namespace splash
+{
+namespace fluid
+{
+// Grid levels with cell sizes doubling from the smallest support radius, for per-particle radii.
+// Each particle is stored at the level whose cell size matches its radius, and searches its own and coarser levels,
+// so a pair of different levels is found from its finer particle within 27 coarse cells.
+// In full lists, particles also search finer levels within their own radius, to find the same pairs from the coarser particle.
+// Cells are found by binary search in particle indices sorted by (level, cell), so no memory is spent on empty cells.
+class NeighborSearchMultiLevelGrid final : public NeighborSearch
+{
+public:
+  NeighborSearchMultiLevelGrid();
+  ~NeighborSearchMultiLevelGrid() override;
+
+  void computeNeighbors(const geom::Particles& particles, float h) override;
+  void computeVariableNeighbors(const geom::Particles& particles, const std::vector<float>& radii) override;
+
+protected:
+  void queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const override;
+
+private:
+  void assignLevels(const geom::Particles& particles, const std::vector<float>& radii);
+  void sortByCell(const geom::Particles& particles);
+  void findNeighbors(const geom::Particles& particles, const std::vector<float>& radii, int i);
+
+  glm::uvec3 cellCoordinate(const glm::vec3& p, int level) const;
+  static uint64_t cellKey(int level, const glm::uvec3& cell);
+
+  static constexpr int maxLevels_ = 16;
+  static constexpr uint32_t cellBits_ = 20;
+
+  glm::vec3 min_{ 0.f };
+  float cellSize_ = 1.f; // Of the finest level
+  int levelCount_ = 0;
+  std::vector<float> levelRadius_; // Largest radius of particles at each level
+
+  std::vector<int> particleLevels_;
+  std::vector<std::pair<uint64_t, uint32_t>> sortedCells_; // Pair of (level, cell) key and particle index
+  std::vector<float> uniformRadii_;
+  std::vector<std::vector<uint32_t>> neighborsPerParticle_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_NEIGHBOR_SEARCH_MULTI_LEVEL_GRID_H_
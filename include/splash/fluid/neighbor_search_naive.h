@@ -7,6 +7,9 @@ namespace splash
 {
 namespace fluid
 {
+// Brute force O(n^2) search, the reference for validating other neighbor searches.
+// Positions are tested in cache-sized blocks of the particle coordinate arrays,
+// so that the distance loop vectorizes.
 class NeighborSearchNaive final : public NeighborSearch
 {
 public:
@@ -15,7 +18,15 @@ public:
 
   void computeNeighbors(const geom::Particles& particles, float h) override;
 
+  bool supportsPeriodicDomain() const override { return true; }
+
 private:
+  // Appends neighbors of particle i among particles [begin, end) in increasing index order
+  void findNeighborsInBlock(const geom::Particles& particles, int i, int begin, int end, float h, std::vector<uint32_t>& neighbors);
+
+  static constexpr int blockSize_ = 1024;
+
+  std::vector<std::vector<uint32_t>> neighborsPerParticle_;
 };
 }
 }
@@ -0,0 +1,69 @@
+#ifndef SPLASH_FLUID_NEIGHBOR_SEARCH_SPARSE_GRID_H_
+#define SPLASH_FLUID_NEIGHBOR_SEARCH_SPARSE_GRID_H_
+
+#include <splash/fluid/neighbor_search.h>
+
+#include <array>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+namespace splash
+{
+namespace fluid
+{
+// Two-level sparse grid for large, mostly empty domains.
+// Bricks of 8x8x8 cells of size h are allocated from a pool only where particles are, and looked up by brick coordinate.
+// Occupancy bitmasks of cells in each brick skip empty cells without touching particle data,
+// so memory scales with the occupied volume rather than with the bounding box.
+class NeighborSearchSparseGrid final : public NeighborSearch
+{
+public:
+  NeighborSearchSparseGrid();
+  ~NeighborSearchSparseGrid() override;
+
+  void computeNeighbors(const geom::Particles& particles, float h) override;
+
+  auto brickCount() const noexcept { return brickCount_; }
+
+protected:
+  void queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const override;
+
+private:
+  static constexpr int brickBits_ = 3;
+  static constexpr int brickSide_ = 1 << brickBits_;
+  static constexpr int cellsPerBrick_ = brickSide_ * brickSide_ * brickSide_;
+
+  // Cell coordinates are clamped so that brick coordinates fit in 21 bits of brick keys
+  static constexpr int maxCellCoordinate_ = (1 << 23) - 1;
+
+  struct Brick
+  {
+    glm::ivec3 coordinate;
+    uint32_t begin; // Offset to sortedIndices_
+    std::array<uint64_t, cellsPerBrick_ / 64> occupancy; // Bit per cell with particles
+    std::array<uint32_t, cellsPerBrick_ + 1> cellStart; // Offsets to sortedIndices_ from begin
+  };
+
+  void buildBricks(const geom::Particles& particles, float h);
+  void findNeighborsInBrick(const geom::Particles& particles, float h, uint32_t brick);
+
+  glm::ivec3 cellCoordinate(const glm::vec3& p, float h) const;
+  static uint64_t brickKey(const glm::ivec3& brick);
+  static int cellIndex(const glm::ivec3& local);
+  static bool occupied(const Brick& brick, int cell);
+
+  float h_ = 1.f; // Cell size
+  std::vector<Brick> bricks_; // Pool, of which the first brickCount_ are in use
+  uint32_t brickCount_ = 0;
+  std::unordered_map<uint64_t, uint32_t> brickIndices_;
+
+  std::vector<glm::ivec3> particleCells_;
+  std::vector<uint32_t> particleBricks_;
+  std::vector<uint32_t> sortedIndices_; // Particle indices sorted by brick, then by cell
+  std::vector<std::vector<uint32_t>> neighborsPerParticle_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_NEIGHBOR_SEARCH_SPARSE_GRID_H_
@@ -5,10 +5,21 @@
 
 #include <glm/glm.hpp>
 
+#include <tbb/enumerable_thread_specific.h>
+
+#include <splash/fluid/cell_list.h>
+#include <splash/fluid/cell_table.h>
+#include <splash/simd/distance_filter.h>
+
 namespace splash
 {
 namespace fluid
 {
+// Cells of size h in an open-addressing table keyed by exact cell coordinates, for unbounded domains.
+// Each occupied cell gets a dense id, and particle indices are kept by cell id,
+// so that nearby cells are found without candidates from colliding cells.
+// Candidate positions are gathered once per home cell and tested several at a time with SIMD instructions.
+// Along periodic axes, the domain is divided into a whole number of cells, and nearby cells wrap around.
 class NeighborSearchSpatialHashing final : public NeighborSearch
 {
 public:
@@ -17,14 +28,55 @@ public:
 
   void computeNeighbors(const geom::Particles& particles, float h) override;
 
+  bool supportsPeriodicDomain() const override { return true; }
+
+protected:
+  void queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const override;
+
 private:
-  void computeNeighborsMultiThreaded(const geom::Particles& particles, float h);
-  void computeNeighborsSingleThreaded(const geom::Particles& particles, float h);
+  // Candidate particles of nearby cells, with positions as coordinate arrays for the distance filter
+  struct Candidates
+  {
+    void clear();
+    void add(const geom::Particles& particles, CellList::Range cellParticles);
+
+    std::vector<uint32_t> indices;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<uint32_t> found; // Within h of a particle, with room for the filter padding
+  };
+
+  void computePeriodicCells(float h);
+  void computeCells(const geom::Particles& particles);
+  void computeCellIds();
+  void computeOccupancy();
+
+  // Searches neighbors of all particles in a cell
+  void findNeighborsInCell(const geom::Particles& particles, uint32_t id);
+
+  // Collects candidate particles of the 27 nearby cells,
+  // or of the home cell followed by the 13 forward cells for symmetric search
+  void gatherCandidates(const geom::Particles& particles, uint32_t id, Candidates& candidates);
+
+  glm::ivec3 cellCoordinate(const glm::vec3& p) const;
+  glm::ivec3 wrapCell(const glm::ivec3& cell) const;
 
-  uint32_t hash3d(const glm::ivec3& p);
+  // Cells in the table, occupied or not, below which emptied cells are kept
+  static constexpr uint32_t minTableSize_ = 1024;
 
-  static constexpr uint32_t hashBucketSize_ = 1000000;
-  std::vector<std::vector<uint32_t>> hashTable_;
+  float h_ = 1.f; // Cell size
+  glm::vec3 periodicCellSize_{ 0.f }; // Along periodic axes, at least h
+  glm::ivec3 periodicCellCount_{ 0 }; // Along periodic axes, 0 along others
+  bool halfStencil_ = true; // Forward cells are distinct, unless a periodic axis has fewer than 3 cells
+  CellTable table_; // Cells occupied since the table was last cleared
+  uint32_t occupiedCells_ = 0; // As of the last build
+  CellList cellParticles_; // Particle indices by cell id, moving only particles that changed cell
+  std::vector<uint32_t> particleCellIds_;
+  std::vector<uint32_t> newCellParticles_;
+  std::vector<glm::ivec3> cells_;
+  simd::DistanceFilter distanceFilter_{ 0.f }; // Within h, with the widest supported instruction set
+  tbb::enumerable_thread_specific<Candidates> candidates_;
   std::vector<std::vector<uint32_t>> neighborsPerParticle_;
 };
 }
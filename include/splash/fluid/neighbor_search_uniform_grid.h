@@ -0,0 +1,69 @@
+#ifndef SPLASH_FLUID_NEIGHBOR_SEARCH_UNIFORM_GRID_H_
+#define SPLASH_FLUID_NEIGHBOR_SEARCH_UNIFORM_GRID_H_
+
+#include <splash/fluid/neighbor_search.h>
+
+#include <array>
+
+#include <glm/glm.hpp>
+
+#include <splash/fluid/cell_list.h>
+
+namespace splash
+{
+namespace fluid
+{
+// Dense uniform grid over the particle bounding box, for bounded domains.
+// Particle indices are kept by cell in a single array, so no memory is allocated per cell.
+// The grid is laid out with a margin around the particles and kept while they stay inside,
+// so that only particles that changed cell are moved between frames.
+// Along periodic axes, the grid spans the periodic domain with a whole number of cells, and nearby cells wrap around.
+class NeighborSearchUniformGrid final : public NeighborSearch
+{
+public:
+  NeighborSearchUniformGrid();
+  ~NeighborSearchUniformGrid() override;
+
+  void computeNeighbors(const geom::Particles& particles, float h) override;
+
+  bool supportsPeriodicDomain() const override { return true; }
+
+protected:
+  void queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const override;
+
+private:
+  void computeBoundingBox(const geom::Particles& particles);
+  void computeGridDimensions(float h);
+  void computeParticleCells(const geom::Particles& particles);
+
+  // Coordinates of cells with offsets -1, 0 and 1 from cell along an axis, the home cell first, without repeating wrapped cells
+  int nearbyCoordinates(const glm::ivec3& cell, int axis, std::array<glm::ivec2, 3>& nearby) const;
+
+  glm::ivec3 cellCoordinate(const glm::vec3& p) const;
+  uint32_t cellIndex(const glm::ivec3& cell) const;
+
+  // Upper bound of cell count, cells are enlarged beyond h when the bounding box gets too large
+  static constexpr uint64_t maxCellCount_ = 1 << 24;
+
+  // Margin of the grid around the bounding box, in units of h
+  static constexpr float margin_ = 2.f;
+
+  glm::vec3 boundsMin_{ 0.f };
+  glm::vec3 boundsMax_{ 0.f };
+
+  // Grid layout
+  glm::vec3 min_{ 0.f };
+  glm::vec3 max_{ 0.f };
+  float h_ = 0.f;
+  PeriodicDomain layoutDomain_;
+  glm::vec3 cellSize_{ 1.f }; // Larger than h along periodic axes, to divide the domain evenly
+  glm::ivec3 dimensions_{ 0 };
+
+  std::vector<uint32_t> particleCells_; // Cell index of each particle
+  CellList cells_;
+  std::vector<std::vector<uint32_t>> neighborsPerParticle_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_NEIGHBOR_SEARCH_UNIFORM_GRID_H_
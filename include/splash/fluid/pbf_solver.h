@@ -0,0 +1,190 @@
+#ifndef SPLASH_FLUID_PBF_SOLVER_H_
+#define SPLASH_FLUID_PBF_SOLVER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <splash/fluid/neighbor_list.h>
+#include <splash/fluid/periodic_domain.h>
+#include <splash/simd/aligned_allocator.h>
+
+namespace splash
+{
+namespace geom
+{
+class Particles;
+}
+
+namespace parallel
+{
+template <typename Key, typename Value>
+class RadixSort;
+}
+
+namespace fluid
+{
+class NeighborSearch;
+class SphKernel;
+
+// Position based fluids over fluid and boundary particles, with boundary particle volumes from boundary neighbors.
+// Owns its scratch buffers, and advances particles by explicit steps, independently of rendering.
+class PbfSolver
+{
+public:
+  struct Parameters
+  {
+    float h = 0.4f; // SPH support radius
+    float restDensity = 997.f;
+    float viscosity = 0.02f;
+    int iterations = 5; // Projection iterations per step
+    glm::vec3 gravity{ 0.f, 0.f, -9.80665f };
+    float neighborSkin = 0.f; // Relative to h
+    bool symmetricNeighbors = false;
+    int reorderInterval = 0; // Steps between reorderings by Morton code, 0 if disabled
+    PeriodicDomain periodicDomain; // Needs a neighbor search supporting it, and periodic extents of at least 2 h
+  };
+
+  PbfSolver();
+  ~PbfSolver();
+
+  void setMultiprocessing(bool flag)
+  {
+    multiprocessing_ = flag;
+  }
+
+  void setParameters(const Parameters& parameters)
+  {
+    parameters_ = parameters;
+  }
+
+  const auto& parameters() const noexcept { return parameters_; }
+
+  // Kernel for densities and viscosity, and kernel for gradients, owned by the caller
+  void setKernels(const SphKernel* kernel, const SphKernel* gradKernel);
+
+  // Owned by the caller. Switching searches invalidates the new one, whose lists may predate a reordering.
+  void setNeighborSearch(NeighborSearch* neighborSearch);
+
+  // Recomputes boundary volumes at the next step, e.g. when boundary particles are added or moved
+  void invalidateBoundaryVolumes()
+  {
+    boundaryVolumesValid_ = false;
+  }
+
+  // Advances fluid particles by dt. Boundary particles are not moved, but get masses from their volumes.
+  // Throws std::invalid_argument if the neighbor search does not support the periodic domain.
+  void step(geom::Particles& particles, float dt);
+
+  // Speed of the fastest fluid particle, e.g. for CFL timesteps
+  float maxSpeed(const geom::Particles& particles) const;
+
+  int neighborRebuildCount() const noexcept { return neighborRebuildCount_; }
+  int neighborUpdateCount() const noexcept { return neighborUpdateCount_; }
+
+private:
+  // Displacements from a particle to its neighbors, with kernel values and gradients of them evaluated in batch.
+  // Neighbor lists with skin contain pairs beyond h, which get zero values and gradients here, so that no pass
+  // needs to filter them. Kernels zero them already unless their support radius exceeds h.
+  struct KernelBatch
+  {
+    uint32_t count = 0;
+    float radiusSquared = 0.f; // Of h
+    simd::AlignedVector<float> x;
+    simd::AlignedVector<float> y;
+    simd::AlignedVector<float> z;
+    simd::AlignedVector<float> w;
+    simd::AlignedVector<float> gx;
+    simd::AlignedVector<float> gy;
+    simd::AlignedVector<float> gz;
+
+    template <typename Kernel>
+    void evaluate(const Kernel& kernel);
+
+    template <typename Kernel>
+    void evaluateGrad(const Kernel& kernel);
+
+    glm::vec3 grad(int k) const { return { gx[k], gy[k], gz[k] }; }
+
+    // Squared length summed in the same order as glm::dot
+    bool withinSupport(int k) const { return x[k] * x[k] + y[k] * y[k] + z[k] * z[k] <= radiusSquared; }
+  };
+
+  struct KernelBatches;
+  struct ScatterBuffers;
+
+  // Fills the batch of the calling thread with displacements from particle i0 to neighbors
+  KernelBatch& gatherDisplacements(const geom::Particles& particles, int i0, NeighborList::Range neighbors);
+
+  void reorderParticles(geom::Particles& particles);
+  void splitParticles(const geom::Particles& particles);
+
+  // Passes specialized for kernel types, which are SphKernel for kernels other than Poly6 and Spiky
+  template <typename Kernel, typename GradKernel>
+  void solve(geom::Particles& particles, float dt, const Kernel& kernel, const GradKernel& gradKernel);
+
+  template <typename Kernel>
+  void updateBoundaryVolumes(geom::Particles& particles, const Kernel& kernel);
+
+  template <typename Kernel>
+  void computeDensities(const geom::Particles& particles, const Kernel& kernel);
+
+  template <typename GradKernel>
+  void computeLambdas(const geom::Particles& particles, const GradKernel& gradKernel);
+
+  template <typename GradKernel>
+  void computeDeltaP(const geom::Particles& particles, const GradKernel& gradKernel);
+
+  template <typename Kernel>
+  void solveViscosity(geom::Particles& particles, const Kernel& kernel);
+
+  template <typename F>
+  void forEach(int begin, int end, F f);
+
+  // Runs f(i, result) where f may add to any element of result, e.g. to both particles of a pair
+  template <typename T, typename F>
+  void forEachScatter(int begin, int end, std::vector<T>& result, const T& zero, F f);
+
+  bool multiprocessing_ = false;
+  Parameters parameters_;
+  const SphKernel* kernel_ = nullptr;
+  const SphKernel* gradKernel_ = nullptr;
+  NeighborSearch* neighborSearch_ = nullptr;
+  PeriodicDomain domain_; // Of the current step
+  int neighborRebuildCount_ = 0;
+  int neighborUpdateCount_ = 0;
+
+  // Boundary masses are recomputed when boundary or kernel changes
+  bool boundaryVolumesValid_ = false;
+  const SphKernel* boundaryKernel_ = nullptr;
+
+  std::vector<glm::vec3> positions_; // Before the step
+  std::vector<int> fluidIndices_;
+  std::vector<int> boundaryIndices_;
+  std::vector<int> toFluidIndex_;
+  std::vector<float> density_;
+
+  // Constraints
+  std::vector<float> incompressibilityLambdas_;
+  std::vector<glm::vec3> deltaP_;
+
+  // Scatter buffers for symmetric neighbors
+  std::vector<float> boundaryDelta_;
+  std::vector<glm::vec4> lambdaGradients_;
+  std::vector<glm::vec3> deltaV_;
+
+  std::unique_ptr<KernelBatches> kernelBatches_; // Per thread
+  std::unique_ptr<ScatterBuffers> scatterBuffers_; // Per thread, for forEachScatter
+
+  // Particle reordering by Morton code of grid cells, for memory locality of neighbors
+  std::vector<uint64_t> mortonCodes_;
+  std::vector<uint32_t> reorderIndices_;
+  std::unique_ptr<parallel::RadixSort<uint64_t, uint32_t>> radixSort_;
+  int reorderStep_ = 0;
+};
+}
+}
+
+#endif // SPLASH_FLUID_PBF_SOLVER_H_
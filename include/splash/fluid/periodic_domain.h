@@ -0,0 +1,78 @@
+#ifndef SPLASH_FLUID_PERIODIC_DOMAIN_H_
+#define SPLASH_FLUID_PERIODIC_DOMAIN_H_
+
+#include <glm/glm.hpp>
+
+namespace splash
+{
+namespace fluid
+{
+// Axis-aligned box wrapping around along its periodic axes.
+// Displacements follow the minimum image convention, which needs periodic extents of at least 2 h.
+class PeriodicDomain
+{
+public:
+  PeriodicDomain() = default;
+
+  PeriodicDomain(const glm::bvec3& periodic, const glm::vec3& min, const glm::vec3& max)
+    : periodic_(periodic), min_(min), max_(max)
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      extent_[axis] = periodic[axis] ? max[axis] - min[axis] : 0.f;
+      invExtent_[axis] = periodic[axis] ? 1.f / extent_[axis] : 0.f;
+    }
+  }
+
+  bool enabled() const noexcept { return periodic_.x || periodic_.y || periodic_.z; }
+
+  const auto& periodic() const noexcept { return periodic_; }
+  const auto& min() const noexcept { return min_; }
+  const auto& max() const noexcept { return max_; }
+  const auto& extent() const noexcept { return extent_; }
+
+  // Whether pairs within radius h have a single image within h, which minimum images need
+  bool supportsRadius(float h) const noexcept
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      if (periodic_[axis] && extent_[axis] < 2.f * h)
+        return false;
+    }
+    return true;
+  }
+
+  // From p1 to p0, to the nearest image of p1. Non-periodic axes have zero extent, so this is branch-free.
+  glm::vec3 displacement(const glm::vec3& p0, const glm::vec3& p1) const
+  {
+    const auto d = p0 - p1;
+    return d - extent_ * glm::round(d * invExtent_);
+  }
+
+  // Into [min, max) along periodic axes
+  glm::vec3 wrap(const glm::vec3& p) const
+  {
+    return p - extent_ * glm::floor((p - min_) * invExtent_);
+  }
+
+  bool operator == (const PeriodicDomain& rhs) const
+  {
+    return periodic_ == rhs.periodic_ && (!enabled() || (min_ == rhs.min_ && max_ == rhs.max_));
+  }
+
+  bool operator != (const PeriodicDomain& rhs) const
+  {
+    return !(*this == rhs);
+  }
+
+private:
+  glm::bvec3 periodic_{ false };
+  glm::vec3 min_{ 0.f };
+  glm::vec3 max_{ 0.f };
+  glm::vec3 extent_{ 0.f }; // Zero along non-periodic axes
+  glm::vec3 invExtent_{ 0.f };
+};
+}
+}
+
+#endif // SPLASH_FLUID_PERIODIC_DOMAIN_H_
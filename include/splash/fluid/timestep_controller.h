@@ -0,0 +1,98 @@
+#ifndef SPLASH_FLUID_TIMESTEP_CONTROLLER_H_
+#define SPLASH_FLUID_TIMESTEP_CONTROLLER_H_
+
+#include <cstdint>
+#include <functional>
+
+namespace splash
+{
+namespace fluid
+{
+// Splits the simulated time of each frame into solver timesteps, independently of the frame rate.
+// Substeps per frame are capped, and simulated time beyond the cap is dropped, so that a slow frame
+// does not lead to more work in the next one.
+class TimestepController
+{
+public:
+  enum class Mode : uint32_t
+  {
+    FIXED, // Fixed timesteps, with the time left over carried to the next frame
+    CFL, // Timesteps as large as the CFL condition allows for the fastest particle, also carrying the time left over
+  };
+
+  // Of the last frame, except the smoothed ratio
+  struct Statistics
+  {
+    int substeps = 0;
+    float timestep = 0.f; // Last substep
+    float simulatedTime = 0.f;
+    float droppedTime = 0.f; // Beyond the substep cap
+    double stepMilliseconds = 0.; // Mean wall time per substep
+    double realTimeRatio = 0.; // Simulated time over wall time, smoothed over frames
+  };
+
+  TimestepController();
+  ~TimestepController();
+
+  void setMode(Mode mode)
+  {
+    mode_ = mode;
+  }
+
+  Mode mode() const noexcept { return mode_; }
+
+  void setFixedTimestep(float timestep)
+  {
+    fixedTimestep_ = timestep;
+  }
+
+  float fixedTimestep() const noexcept { return fixedTimestep_; }
+
+  // Fraction of h that the fastest particle may move per timestep
+  void setCflNumber(float cflNumber)
+  {
+    cflNumber_ = cflNumber;
+  }
+
+  float cflNumber() const noexcept { return cflNumber_; }
+
+  // Bounds of CFL timesteps, the upper one also used when particles are at rest
+  void setTimestepRange(float minTimestep, float maxTimestep)
+  {
+    minTimestep_ = minTimestep;
+    maxTimestep_ = maxTimestep;
+  }
+
+  void setMaxSubsteps(int maxSubsteps)
+  {
+    maxSubsteps_ = maxSubsteps;
+  }
+
+  int maxSubsteps() const noexcept { return maxSubsteps_; }
+
+  // Discards the time carried over, e.g. when the simulation is reset
+  void reset();
+
+  // Advances simulated time by frameTime, over wallTime seconds of wall-clock time since the last frame.
+  // step(dt) advances the simulation by dt, and maxSpeed() gives the speed of the fastest particle for CFL timesteps.
+  void advance(float frameTime, float wallTime, float h, const std::function<void(float)>& step, const std::function<float()>& maxSpeed);
+
+  const Statistics& statistics() const noexcept { return statistics_; }
+
+private:
+  float cflTimestep(float h, float maxSpeed) const;
+
+  Mode mode_ = Mode::FIXED;
+  float fixedTimestep_ = 1.f / 120.f;
+  float cflNumber_ = 0.4f;
+  float minTimestep_ = 1.f / 2000.f;
+  float maxTimestep_ = 1.f / 60.f;
+  int maxSubsteps_ = 4;
+
+  float accumulator_ = 0.f; // Simulated time not yet stepped
+  Statistics statistics_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_TIMESTEP_CONTROLLER_H_
@@ -0,0 +1,33 @@
+#ifndef SPLASH_GEOM_MORTON_H_
+#define SPLASH_GEOM_MORTON_H_
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+namespace splash
+{
+namespace geom
+{
+constexpr uint32_t mortonBits = 21;
+
+inline uint64_t splitBy3(uint32_t a)
+{
+  uint64_t x = a & 0x1fffff; // we only look at the first 21 bits
+  x = (x | x << 32) & 0x1f00000000ffff; // shift left 32 bits, OR with self, and 00011111000000000000000000000000000000001111111111111111
+  x = (x | x << 16) & 0x1f0000ff0000ff; // shift left 32 bits, OR with self, and 00011111000000000000000011111111000000000000000011111111
+  x = (x | x << 8) & 0x100f00f00f00f00f; // shift left 32 bits, OR with self, and 0001000000001111000000001111000000001111000000001111000000000000
+  x = (x | x << 4) & 0x10c30c30c30c30c3; // shift left 32 bits, OR with self, and 0001000011000011000011000011000011000011000011000011000100000000
+  x = (x | x << 2) & 0x1249249249249249;
+  return x;
+}
+
+// Interleaves 21 bits of each coordinate into a 63-bit Morton code
+inline uint64_t morton(const glm::uvec3& p)
+{
+  return splitBy3(p.x) | splitBy3(p.y) << 1 | splitBy3(p.z) << 2;
+}
+}
+}
+
+#endif // SPLASH_GEOM_MORTON_H_
@@ -13,6 +13,7 @@ enum class ParticleType : uint32_t
   BOUNDARY,
 };
 
+// All attributes of a particle, in the instance layout of rendering
 struct Particle
 {
   alignas(16) glm::vec3 position;
@@ -5,11 +5,14 @@
 #include <vector>
 
 #include <splash/geom/particle.h>
+#include <splash/simd/aligned_allocator.h>
 
 namespace splash
 {
 namespace geom
 {
+// Particle attributes in separate contiguous arrays, each aligned for SIMD loads, so that a pass reading
+// positions and masses does not also load velocities and colors. Particle gathers the attributes of one particle.
 class Particles
 {
 public:
@@ -19,18 +22,73 @@ public:
   const auto& radius() const noexcept { return radius_; }
   auto& radius() noexcept { return radius_; }
 
-  const auto size() const noexcept { return static_cast<uint32_t>(particles_.size()); }
-  const auto& data() const noexcept { return particles_; }
-  auto& data() noexcept { return particles_; }
+  const auto size() const noexcept { return static_cast<uint32_t>(x_.size()); }
 
-  const auto& operator [] (int index) const { return particles_[index]; }
-  auto& operator [] (int index) { return particles_[index]; }
+  // Position coordinates
+  const auto& x() const noexcept { return x_; }
+  const auto& y() const noexcept { return y_; }
+  const auto& z() const noexcept { return z_; }
 
+  glm::vec3 position(int index) const { return { x_[index], y_[index], z_[index] }; }
+
+  void setPosition(int index, const glm::vec3& position)
+  {
+    x_[index] = position.x;
+    y_[index] = position.y;
+    z_[index] = position.z;
+  }
+
+  const auto& velocity(int index) const { return velocities_[index]; }
+  auto& velocity(int index) { return velocities_[index]; }
+
+  const auto& mass(int index) const { return masses_[index]; }
+  auto& mass(int index) { return masses_[index]; }
+
+  const auto& type(int index) const { return types_[index]; }
+  auto& type(int index) { return types_[index]; }
+
+  const auto& color(int index) const { return colors_[index]; }
+  auto& color(int index) { return colors_[index]; }
+
+  Particle get(int index) const;
+  void set(int index, const Particle& particle);
+
+  // Gathers all particles into the instance layout of rendering
+  void pack(std::vector<Particle>& packed) const;
+
+  // Slot of ids of particles removed by resize
+  static constexpr uint32_t noSlot = 0xffffffff;
+
+  // Particle ids stay with particles when they are reordered and when particles are resized
+  auto id(int index) const { return ids_[index]; }
+  auto slot(uint32_t id) const { return slots_[id]; }
+
+  // Keeps the particles and ids of the first n slots. Appended slots get the smallest unused ids.
   void resize(uint32_t n);
 
+  // Moves the particle at slot order[i] to slot i
+  void reorder(const std::vector<uint32_t>& order);
+
 private:
-  std::vector<Particle> particles_;
+  // Permutes values by order, through a buffer of the same type that is swapped in
+  template <typename T>
+  static void reorderArray(simd::AlignedVector<T>& values, simd::AlignedVector<T>& buffer, const std::vector<uint32_t>& order);
+
+  simd::AlignedVector<float> x_;
+  simd::AlignedVector<float> y_;
+  simd::AlignedVector<float> z_;
+  simd::AlignedVector<glm::vec3> velocities_;
+  simd::AlignedVector<float> masses_;
+  simd::AlignedVector<ParticleType> types_;
+  simd::AlignedVector<glm::vec3> colors_;
   float radius_ = 1.f;
+
+  std::vector<uint32_t> ids_; // Slot to id
+  std::vector<uint32_t> slots_; // Id to slot, over all ids ever assigned
+  std::vector<uint32_t> reorderedIds_;
+  simd::AlignedVector<float> reorderedFloats_;
+  simd::AlignedVector<glm::vec3> reorderedVectors_;
+  simd::AlignedVector<ParticleType> reorderedTypes_;
 };
 }
 }
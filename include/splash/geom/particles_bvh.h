@@ -1,9 +1,14 @@
 #ifndef SPLASH_GEOM_PARTICLES_BVH_H_
 #define SPLASH_GEOM_PARTICLES_BVH_H_
 
+#include <atomic>
+#include <functional>
+#include <vector>
+
 #include <glm/glm.hpp>
 
 #include <splash/geom/particles.h>
+#include <splash/parallel/primitives.h>
 
 namespace splash
 {
@@ -11,14 +16,39 @@ namespace geom
 {
 class Particles;
 
+// Linear BVH over particle positions, after Karras (2012).
+// Leaves are particles sorted by Morton code, and the n - 1 internal nodes are determined from the sorted codes,
+// with the root at internal node 0. Queries test particle positions at construction.
 class ParticlesBvh
 {
 public:
   ParticlesBvh();
   ~ParticlesBvh();
 
+  // Construction with parallel radix sort, node build and bottom-up bounding boxes
+  void setMultiprocessing(bool flag = true) { multiprocessing_ = flag; }
+
   void construct(const Particles& particles);
 
+  // Appends indices of particles within radius of center, inclusive, in no particular order
+  void query(const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const;
+
+  // Appends indices of particles within radius of a leaf, among the leaves after it in morton order only,
+  // pruning subtrees of earlier leaves, so that querying every leaf finds each pair once
+  void queryFollowingLeaves(int leaf, float radius, std::vector<uint32_t>& indices) const;
+
+  // Particle index of the leaf at a position in morton order
+  uint32_t leafParticle(int leaf) const { return indices_[leaf]; }
+
+  // Appends indices of the k particles nearest to center, by increasing distance, or of all particles if fewer
+  void nearest(const glm::vec3& center, int k, std::vector<uint32_t>& indices) const;
+
+  // Batched queries, replacing indices of each center, in parallel over centers with multiprocessing
+  void query(const std::vector<glm::vec3>& centers, float radius, std::vector<std::vector<uint32_t>>& indices) const;
+  void nearest(const std::vector<glm::vec3>& centers, int k, std::vector<std::vector<uint32_t>>& indices) const;
+
+  const auto size() const noexcept { return static_cast<uint32_t>(positions_.size()); }
+
 private:
   struct Range
   {
@@ -26,18 +56,41 @@ private:
     int right;
   };
 
+  // Children are internal node indices if non-negative, and ~leaf otherwise
+  struct Node
+  {
+    glm::vec3 min;
+    int left;
+    glm::vec3 max;
+    int right;
+  };
+
+  // Leaves before firstLeaf are skipped
+  void query(const glm::vec3& center, float radius, int firstLeaf, std::vector<uint32_t>& indices) const;
+
+  void forEach(int begin, int end, std::function<void(int)> f) const;
+
   void computeBoundingBox();
   void sortByMortonCode();
   uint64_t mortonCode(glm::vec3 p);
   void computeTreeRanges();
-  int findSplit(int left, int right);
-  Range findRange(int pivot);
+  void computeNodeBoundingBoxes();
+  int commonPrefix(int i, int j) const;
+  int findSplit(const Range& range) const;
+  Range findRange(int pivot) const;
+
+  bool multiprocessing_ = false;
 
   const Particles* particles_ = nullptr;
-  std::vector<std::pair<uint64_t, uint32_t>> mortons_; // Pair of morton and index
-  Particles sorted_;
+  std::vector<uint64_t> mortons_; // Sorted morton codes of leaves
+  parallel::RadixSort<uint64_t, uint32_t> radixSort_;
+  std::vector<glm::vec3> positions_; // Leaf positions, in morton order
+  std::vector<uint32_t> indices_; // Particle index of each leaf
 
-  std::vector<Range> ranges_;
+  std::vector<Node> nodes_;
+  std::vector<int> lastLeaves_; // Last leaf in the range of each internal node
+  std::vector<int> parents_; // Parent internal node of internal nodes, then of leaves
+  std::vector<std::atomic<int>> visits_;
 
   glm::vec3 min_{ 0.f };
   glm::vec3 max_{ 0.f };
@@ -2,6 +2,9 @@
 #define SPLASH_GL_PARTICLES_GEOMETRY_H_
 
 #include <cstdint>
+#include <vector>
+
+#include <splash/geom/particle.h>
 
 namespace splash
 {
@@ -25,6 +28,7 @@ public:
 
 private:
   uint32_t particleCount_ = 0;
+  std::vector<geom::Particle> instances_; // Particles packed into the instance layout on update
 
   // Sphere
   uint32_t indexCount_ = 0;
@@ -0,0 +1,218 @@
+#ifndef SPLASH_PARALLEL_PRIMITIVES_H_
+#define SPLASH_PARALLEL_PRIMITIVES_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <tbb/tbb.h>
+
+namespace splash
+{
+namespace parallel
+{
+// Data-parallel building blocks over index ranges, backed by TBB with multiprocessing and serial loops otherwise.
+// Serial and parallel runs give the same results.
+
+// Calls f(i) for i in [begin, end)
+template <typename F>
+void forEach(int begin, int end, F f, bool multiprocessing)
+{
+  if (multiprocessing)
+  {
+    tbb::parallel_for(tbb::blocked_range<int>(begin, end),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        for (int i = range.begin(); i < range.end(); i++)
+          f(i);
+      });
+  }
+  else
+  {
+    for (int i = begin; i < end; i++)
+      f(i);
+  }
+}
+
+// Exclusive prefix sum of count(i) over [0, n), calling visit(i, offset) with the sum of counts before i, and returning the total.
+// With multiprocessing, count may be called twice per element, so it should be cheap and free of side effects.
+// count(i) is always called before visit(i, offset), which may then overwrite what count reads.
+template <typename T, typename Count, typename Visit>
+T exclusiveScan(int n, Count count, Visit visit, bool multiprocessing)
+{
+  if (!multiprocessing)
+  {
+    T sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+      const T value = count(i);
+      visit(i, sum);
+      sum += value;
+    }
+    return sum;
+  }
+
+  return tbb::parallel_scan(tbb::blocked_range<int>(0, n), T(0),
+    [&](const tbb::blocked_range<int>& range, T sum, bool isFinalScan)
+    {
+      for (int i = range.begin(); i < range.end(); i++)
+      {
+        const T value = count(i);
+        if (isFinalScan)
+          visit(i, sum);
+        sum += value;
+      }
+      return sum;
+    },
+    [](T a, T b) { return a + b; });
+}
+
+// Exclusive prefix sum of counts into offsets, with the total at offsets[n]
+template <typename T>
+void exclusiveScan(const std::vector<T>& counts, std::vector<T>& offsets, bool multiprocessing)
+{
+  const int n = counts.size();
+  offsets.resize(n + 1);
+  offsets[n] = exclusiveScan<T>(n,
+    [&](int i) { return counts[i]; },
+    [&](int i, T offset) { offsets[i] = offset; },
+    multiprocessing);
+}
+
+// Stream compaction, writing i in increasing order for which keep(i), and returning their count.
+// out needs room for n indices.
+template <typename Keep>
+uint32_t compact(int n, Keep keep, uint32_t* out, bool multiprocessing)
+{
+  return exclusiveScan<uint32_t>(n,
+    [&](int i) { return keep(i) ? 1u : 0u; },
+    [&](int i, uint32_t offset)
+    {
+      if (keep(i))
+        out[offset] = i;
+    },
+    multiprocessing);
+}
+
+// Bin count from which histogram bins are summed up in parallel
+constexpr uint32_t parallelBinCount = 4096;
+
+// Counts of bin(i) over [0, n) in binCount bins. With multiprocessing, each thread counts into its own bins,
+// which are summed up at the end, so binCount should be small compared to n.
+template <typename Bin>
+void histogram(int n, Bin bin, uint32_t binCount, std::vector<uint32_t>& counts, bool multiprocessing)
+{
+  counts.assign(binCount, 0);
+  if (!multiprocessing)
+  {
+    for (int i = 0; i < n; i++)
+      counts[bin(i)]++;
+    return;
+  }
+
+  tbb::enumerable_thread_specific<std::vector<uint32_t>> localCounts([binCount]() { return std::vector<uint32_t>(binCount, 0); });
+  tbb::parallel_for(tbb::blocked_range<int>(0, n),
+    [&](const tbb::blocked_range<int>& range)
+    {
+      auto& local = localCounts.local();
+      for (int i = range.begin(); i < range.end(); i++)
+        local[bin(i)]++;
+    });
+
+  forEach(0, binCount, [&](int b)
+    {
+      for (const auto& local : localCounts)
+        counts[b] += local[b];
+    }, binCount >= parallelBinCount);
+}
+
+// Stable LSD radix sort of values by unsigned integer keys, reusing its buffers between sorts.
+// Each pass counts the digits of blocks of keys in parallel, then scatters each block in order to its own range of each digit.
+template <typename Key, typename Value>
+class RadixSort
+{
+public:
+  RadixSort() = default;
+  ~RadixSort() = default;
+
+  void setMultiprocessing(bool flag = true) { multiprocessing_ = flag; }
+
+  // Sorts keys, and values along, by the keyBits least significant bits of keys
+  void sort(std::vector<Key>& keys, std::vector<Value>& values, int keyBits = 8 * sizeof(Key))
+  {
+    const int n = keys.size();
+    const auto blockCount = (n + blockSize_ - 1) / blockSize_;
+
+    keysBuffer_.resize(n);
+    valuesBuffer_.resize(n);
+    offsets_.resize(blockCount * digitCount_);
+
+    for (int shift = 0; shift < keyBits; shift += digitBits_)
+    {
+      const auto digit = [shift](Key key) { return static_cast<uint32_t>(key >> shift) & (digitCount_ - 1); };
+
+      // Histogram of each block
+      forEach(0, blockCount, [&](int block)
+        {
+          auto* counts = &offsets_[block * digitCount_];
+          std::fill(counts, counts + digitCount_, 0);
+
+          const auto end = std::min(n, (block + 1) * blockSize_);
+          for (int i = block * blockSize_; i < end; i++)
+            counts[digit(keys[i])]++;
+        }, multiprocessing_);
+
+      // Exclusive prefix sum in digit-major, block-minor order.
+      // A pass where all keys have the same digit keeps the order, so it is skipped.
+      uint32_t offset = 0;
+      bool skip = false;
+      for (int d = 0; d < digitCount_; d++)
+      {
+        const auto digitBegin = offset;
+        for (int block = 0; block < blockCount; block++)
+        {
+          const auto count = offsets_[block * digitCount_ + d];
+          offsets_[block * digitCount_ + d] = offset;
+          offset += count;
+        }
+
+        if (offset - digitBegin == static_cast<uint32_t>(n))
+          skip = true;
+      }
+
+      if (skip)
+        continue;
+
+      // Scatter of each block in order, to its own range of each digit
+      forEach(0, blockCount, [&](int block)
+        {
+          auto* offsets = &offsets_[block * digitCount_];
+
+          const auto end = std::min(n, (block + 1) * blockSize_);
+          for (int i = block * blockSize_; i < end; i++)
+          {
+            const auto target = offsets[digit(keys[i])]++;
+            keysBuffer_[target] = keys[i];
+            valuesBuffer_[target] = values[i];
+          }
+        }, multiprocessing_);
+
+      keys.swap(keysBuffer_);
+      values.swap(valuesBuffer_);
+    }
+  }
+
+private:
+  static constexpr int digitBits_ = 8;
+  static constexpr int digitCount_ = 1 << digitBits_;
+  static constexpr int blockSize_ = 1 << 14;
+
+  bool multiprocessing_ = false;
+  std::vector<Key> keysBuffer_;
+  std::vector<Value> valuesBuffer_;
+  std::vector<uint32_t> offsets_; // Per block and digit
+};
+}
+}
+
+#endif // SPLASH_PARALLEL_PRIMITIVES_H_
@@ -0,0 +1,46 @@
+#ifndef SPLASH_PARALLEL_PRIMITIVES_BENCHMARK_H_
+#define SPLASH_PARALLEL_PRIMITIVES_BENCHMARK_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace splash
+{
+namespace parallel
+{
+// Measures parallel primitives on random input against TBB thread count
+class PrimitivesBenchmark
+{
+public:
+  struct Timing
+  {
+    std::string primitive;
+    int threads = 0;
+    double milliseconds = 0.;
+    double speedup = 1.;
+  };
+
+  PrimitivesBenchmark();
+  ~PrimitivesBenchmark();
+
+  void setRepeats(int repeats)
+  {
+    repeats_ = repeats;
+  }
+
+  // Runs each primitive over n elements serially, then with 1, 2, 4, ... threads up to the available concurrency
+  void measureScaling(int n);
+
+  const auto& timings() const noexcept { return timings_; }
+
+  void printReport(std::ostream& out) const;
+
+private:
+  int repeats_ = 5;
+  std::vector<Timing> timings_;
+};
+}
+}
+
+#endif // SPLASH_PARALLEL_PRIMITIVES_BENCHMARK_H_
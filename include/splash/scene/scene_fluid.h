@@ -8,6 +8,7 @@
 
 #include <glm/glm.hpp>
 
+#include <splash/fluid/periodic_domain.h>
 #include <splash/scene/scene.h>
 
 namespace splash
@@ -26,7 +27,9 @@ class Particles;
 namespace fluid
 {
 class NeighborSearch;
+class PbfSolver;
 class SphKernel;
+class TimestepController;
 }
 
 namespace scene
@@ -49,9 +52,10 @@ private:
 
   void initializeParticles();
   void updateFluidParticles();
-  void updateParticles(float dt);
+  void updateParticles(float frameTime, float wallTime);
 
-  void forEach(int begin, int end, std::function<void(int)> f);
+  // The selected neighbor search, or spatial hashing if the selected one does not support the periodic domain
+  fluid::NeighborSearch& neighborSearch();
 
   static constexpr uint32_t maxFluidSide_ = 64;
   static constexpr uint32_t maxFluidCount_ = maxFluidSide_ * maxFluidSide_ * maxFluidSide_;
@@ -60,6 +64,7 @@ private:
   int fluidSideX_ = 16;
   int fluidSideY_ = 16;
   int fluidSideZ_ = 32;
+  bool periodicX_ = false; // Periodic domain along x instead of walls
   uint32_t fluidCount_ = 0;
   uint32_t particleCount_ = 0;
   std::unique_ptr<geom::Particles> particles_;
@@ -67,19 +72,13 @@ private:
   std::unique_ptr<gl::ParticlesGeometry> particlesGeometry_;
 
   // Fluid simulation
-  std::vector<glm::vec3> positions_;
-  std::unique_ptr<fluid::NeighborSearch> neighborSearch_;
-  std::vector<std::vector<int>> neighborIndices_;
-  std::vector<int> fluidIndices_;
-  std::vector<int> boundaryIndices_;
-  std::vector<int> toFluidIndex_;
-  std::vector<float> density_;
+  std::unique_ptr<fluid::PbfSolver> solver_;
+  std::unique_ptr<fluid::TimestepController> timestepController_;
+  fluid::PeriodicDomain periodicDomain_;
+  std::vector<std::unique_ptr<fluid::NeighborSearch>> neighborSearches_;
   float rho0_ = 0.f; // Rest density
   float timestepScale_ = 1.f;
-
-  // Fluid simulation - constraints
-  std::vector<float> incompressibilityLambdas_;
-  std::vector<glm::vec3> deltaP_;
+  int reorderInterval_ = 0; // Steps between reorderings, 0 if disabled
 
   // Animation
   float animationTime_ = 0.f;
@@ -88,11 +87,15 @@ private:
   // Rendering options
   bool animation_ = false;
   bool multiprocessing_ = false;
+  bool symmetricNeighbors_ = false;
+  bool neighborStatistics_ = false;
+  float neighborSkin_ = 0.f; // Relative to h
   int timestepScaleLevel_ = 0; // Relates to timestep scale
 
   std::vector<std::unique_ptr<fluid::SphKernel>> kernels_;
   int kernelIndex_ = 0;
   int gradKernelIndex_ = 1;
+  int neighborSearchIndex_ = 0;
   float viscosity_ = 0.02f;
 
   bool showBoundary_ = false;
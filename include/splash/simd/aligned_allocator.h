@@ -0,0 +1,49 @@
+#ifndef SPLASH_SIMD_ALIGNED_ALLOCATOR_H_
+#define SPLASH_SIMD_ALIGNED_ALLOCATOR_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace splash
+{
+namespace simd
+{
+// Alignment of the widest vector registers, and of cache lines
+constexpr std::size_t alignment = 64;
+
+// Allocates arrays starting at a multiple of alignment, so that vector loads from the start never split cache lines
+template <typename T>
+class AlignedAllocator
+{
+public:
+  using value_type = T;
+
+  AlignedAllocator() noexcept = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignment)));
+  }
+
+  void deallocate(T* p, std::size_t) noexcept
+  {
+    ::operator delete(p, std::align_val_t(alignment));
+  }
+
+  template <typename U>
+  bool operator == (const AlignedAllocator<U>&) const noexcept { return true; }
+
+  template <typename U>
+  bool operator != (const AlignedAllocator<U>&) const noexcept { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+}
+}
+
+#endif // SPLASH_SIMD_ALIGNED_ALLOCATOR_H_
@@ -0,0 +1,28 @@
+#ifndef SPLASH_SIMD_CPU_FEATURES_H_
+#define SPLASH_SIMD_CPU_FEATURES_H_
+
+#include <cstdint>
+
+namespace splash
+{
+namespace simd
+{
+// Instruction sets with a vectorized code path, from narrowest to widest
+enum class InstructionSet : uint32_t
+{
+  SCALAR,
+  SSE41,
+  AVX2,
+  AVX512,
+};
+
+// Widest instruction set supported by both the CPU and the operating system, detected once
+InstructionSet supportedInstructionSet();
+
+bool isSupported(InstructionSet instructionSet);
+
+const char* instructionSetName(InstructionSet instructionSet);
+}
+}
+
+#endif // SPLASH_SIMD_CPU_FEATURES_H_
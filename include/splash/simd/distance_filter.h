@@ -0,0 +1,50 @@
+#ifndef SPLASH_SIMD_DISTANCE_FILTER_H_
+#define SPLASH_SIMD_DISTANCE_FILTER_H_
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include <splash/simd/cpu_features.h>
+
+namespace splash
+{
+namespace simd
+{
+// Selects candidates within a radius of a center, testing 4, 8 or 16 candidates at a time.
+// Candidate positions are given as separate coordinate arrays. Along axes with a nonzero periodic extent,
+// distances follow the minimum image convention. Squared distances are summed in the same order as glm::dot,
+// so that results match a scalar test exactly.
+class DistanceFilter
+{
+public:
+  // Extra room for indices in the output, written past the survivors
+  static constexpr uint32_t padding = 8;
+
+  // With the widest supported instruction set, or the given one if supported
+  explicit DistanceFilter(float radius, const glm::vec3& periodicExtent = glm::vec3(0.f));
+  DistanceFilter(float radius, const glm::vec3& periodicExtent, InstructionSet instructionSet);
+
+  auto instructionSet() const noexcept { return instructionSet_; }
+
+  // Writes indices[k] of candidates k within radius of center, inclusive, to out in candidate order, and returns their count.
+  // out needs room for count + padding indices.
+  uint32_t operator () (const glm::vec3& center, const float* x, const float* y, const float* z, const uint32_t* indices, uint32_t count, uint32_t* out) const
+  {
+    return filter_(radiusSquared_, extent_, invExtent_, center, x, y, z, indices, count, out);
+  }
+
+private:
+  using Filter = uint32_t(*)(float radiusSquared, const glm::vec3& extent, const glm::vec3& invExtent,
+    const glm::vec3& center, const float* x, const float* y, const float* z, const uint32_t* indices, uint32_t count, uint32_t* out);
+
+  InstructionSet instructionSet_ = InstructionSet::SCALAR;
+  Filter filter_ = nullptr;
+  float radiusSquared_ = 0.f;
+  glm::vec3 extent_{ 0.f };
+  glm::vec3 invExtent_{ 0.f };
+};
+}
+}
+
+#endif // SPLASH_SIMD_DISTANCE_FILTER_H_
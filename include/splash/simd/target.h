@@ -0,0 +1,16 @@
+#ifndef SPLASH_SIMD_TARGET_H_
+#define SPLASH_SIMD_TARGET_H_
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPLASH_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Code paths of wider instruction sets are compiled for them per function, and only called when supported
+#if defined(SPLASH_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SPLASH_SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SPLASH_SIMD_TARGET(isa)
+#endif
+
+#endif // SPLASH_SIMD_TARGET_H_
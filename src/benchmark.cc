@@ -0,0 +1,180 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <splash/fluid/neighbor_search_benchmark.h>
+#include <splash/fluid/neighbor_search_bvh.h>
+#include <splash/fluid/neighbor_search_multi_level_grid.h>
+#include <splash/fluid/neighbor_search_sparse_grid.h>
+#include <splash/fluid/neighbor_search_spatial_hashing.h>
+#include <splash/fluid/neighbor_search_uniform_grid.h>
+#include <splash/fluid/pbf_solver.h>
+#include <splash/fluid/sph_kernel.h>
+#include <splash/geom/particles.h>
+#include <splash/parallel/primitives_benchmark.h>
+#include <splash/simd/cpu_features.h>
+
+namespace
+{
+using namespace splash;
+
+constexpr float radius = 0.1f;
+constexpr float h = 4.f * radius;
+constexpr float restDensity = 997.f;
+
+// Fluid block in a box of boundary particles, as initialized by the fluid scene
+geom::Particles createDamBreak(int sideX, int sideY, int sideZ)
+{
+  const auto fluidCount = sideX * sideY * sideZ;
+  const auto mass = 0.8f * restDensity * 8.f * radius * radius * radius; // Cubic particle
+  geom::Particles particles(fluidCount + (sideX * 3 * sideY + sideY * sideZ + sideZ * sideX * 3) * 2);
+  particles.radius() = radius;
+
+  int index = 0;
+  const auto add = [&](const glm::vec3& position, geom::ParticleType type)
+  {
+    geom::Particle particle{};
+    particle.type = type;
+    particle.position = position * 2.f * radius;
+    particle.mass = type == geom::ParticleType::FLUID ? mass : 0.f;
+    particles.set(index++, particle);
+  };
+
+  for (int i = 0; i < sideX; i++)
+  {
+    for (int j = 0; j < sideY; j++)
+    {
+      for (int k = 0; k < sideZ; k++)
+        add(glm::vec3(i + 1, j + 1, k + 1), geom::ParticleType::FLUID);
+    }
+  }
+
+  for (int i = 0; i < sideX * 3; i++)
+  {
+    for (int j = 0; j < sideY; j++)
+    {
+      add(glm::vec3(i + 1, j + 1, 0), geom::ParticleType::BOUNDARY);
+      add(glm::vec3(i + 1, j + 1, sideZ + 1), geom::ParticleType::BOUNDARY);
+    }
+
+    for (int j = 0; j < sideZ; j++)
+    {
+      add(glm::vec3(i + 1, 0, j + 1), geom::ParticleType::BOUNDARY);
+      add(glm::vec3(i + 1, sideY + 1, j + 1), geom::ParticleType::BOUNDARY);
+    }
+  }
+
+  for (int i = 0; i < sideY; i++)
+  {
+    for (int j = 0; j < sideZ; j++)
+    {
+      add(glm::vec3(0, i + 1, j + 1), geom::ParticleType::BOUNDARY);
+      add(glm::vec3(sideX * 3 + 1, i + 1, j + 1), geom::ParticleType::BOUNDARY);
+    }
+  }
+
+  return particles;
+}
+
+void benchmarkNeighborSearches()
+{
+  const auto particles = createDamBreak(16, 16, 32);
+  std::cout << particles.size() << " particles" << std::endl;
+
+  std::vector<std::pair<std::string, std::unique_ptr<fluid::NeighborSearch>>> neighborSearches;
+  neighborSearches.emplace_back("Spatial hashing", std::make_unique<fluid::NeighborSearchSpatialHashing>());
+  neighborSearches.emplace_back("Uniform grid", std::make_unique<fluid::NeighborSearchUniformGrid>());
+  neighborSearches.emplace_back("BVH", std::make_unique<fluid::NeighborSearchBvh>());
+  neighborSearches.emplace_back("Multi-level grid", std::make_unique<fluid::NeighborSearchMultiLevelGrid>());
+  neighborSearches.emplace_back("Sparse grid", std::make_unique<fluid::NeighborSearchSparseGrid>());
+
+  fluid::NeighborSearchBenchmark benchmark;
+  for (const auto& neighborSearch : neighborSearches)
+  {
+    benchmark.measureScaling(*neighborSearch.second, particles, h);
+    benchmark.printReport(std::cout, neighborSearch.first);
+  }
+}
+
+// Milliseconds per solver step with the given kernel instruction set, from the initial dam break
+double measureSolverSteps(simd::InstructionSet instructionSet, int steps)
+{
+  auto particles = createDamBreak(16, 16, 32);
+
+  fluid::SphKernelPoly6 kernel(h);
+  fluid::SphKernelSpiky gradKernel(h);
+  kernel.setInstructionSet(instructionSet);
+  gradKernel.setInstructionSet(instructionSet);
+
+  fluid::NeighborSearchSpatialHashing neighborSearch;
+  fluid::PbfSolver::Parameters parameters;
+  parameters.h = h;
+  parameters.restDensity = restDensity;
+
+  fluid::PbfSolver solver;
+  solver.setParameters(parameters);
+  solver.setKernels(&kernel, &gradKernel);
+  solver.setNeighborSearch(&neighborSearch);
+
+  constexpr float dt = 1.f / 120.f;
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < steps; i++)
+    solver.step(particles, dt);
+  const auto finish = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count() / steps;
+}
+
+void benchmarkSolver()
+{
+  constexpr int steps = 60;
+  const auto scalar = measureSolverSteps(simd::InstructionSet::SCALAR, steps);
+  std::cout << "Solver, " << simd::instructionSetName(simd::InstructionSet::SCALAR) << " kernels: " << scalar << " ms/step" << std::endl;
+
+  for (auto instructionSet : { simd::InstructionSet::AVX2, simd::InstructionSet::AVX512 })
+  {
+    if (!simd::isSupported(instructionSet))
+      continue;
+
+    const auto vectorized = measureSolverSteps(instructionSet, steps);
+    std::cout << "Solver, " << simd::instructionSetName(instructionSet) << " kernels: " << vectorized << " ms/step, "
+      << scalar / vectorized << "x speedup" << std::endl;
+  }
+}
+
+void benchmarkPrimitives()
+{
+  // Millions of elements, as in per-particle arrays of large scenes
+  constexpr int n = 1 << 22;
+  parallel::PrimitivesBenchmark benchmark;
+  benchmark.measureScaling(n);
+  benchmark.printReport(std::cout);
+}
+}
+
+// Non-interactive benchmarks, with neighbor searches and solver steps on the default particles of the fluid scene.
+// Runs the benchmark given as argument, or all of them.
+int main(int argc, char** argv)
+{
+  const std::string benchmark = argc > 1 ? argv[1] : "";
+  if (!benchmark.empty() && benchmark != "neighbor-search" && benchmark != "solver" && benchmark != "primitives")
+  {
+    std::cerr << "Usage: " << argv[0] << " [neighbor-search | solver | primitives]" << std::endl;
+    return 1;
+  }
+
+  if (benchmark.empty() || benchmark == "neighbor-search")
+    benchmarkNeighborSearches();
+
+  if (benchmark.empty() || benchmark == "solver")
+    benchmarkSolver();
+
+  if (benchmark.empty() || benchmark == "primitives")
+    benchmarkPrimitives();
+
+  return 0;
+}
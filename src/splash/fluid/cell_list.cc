@@ -0,0 +1,193 @@
+#include <splash/fluid/cell_list.h>
+
+#include <algorithm>
+
+#include <splash/parallel/primitives.h>
+
+namespace splash
+{
+namespace fluid
+{
+CellList::CellList() = default;
+
+CellList::~CellList() = default;
+
+bool CellList::update(const std::vector<uint32_t>& particleCells, uint32_t cellCount)
+{
+  const int n = particleCells.size();
+  movedCount_ = 0;
+
+  auto rebuild = !valid_ || cellCount != this->cellCount() || n != particleCells_.size();
+
+  if (!rebuild)
+  {
+    // Compaction of particles that changed cell, in index order
+    changed_.resize(n);
+    movedCount_ = parallel::compact(n, [&](int i) { return particleCells[i] != particleCells_[i]; }, changed_.data(), multiprocessing_);
+    changed_.resize(movedCount_);
+
+    rebuild = movedCount_ > rebuildRatio_ * n;
+  }
+
+  if (!rebuild)
+  {
+    moveChangedParticles(particleCells);
+
+    // Grown cells leave their former slots unused
+    rebuild = indices_.size() > 2 * rebuiltSize_;
+  }
+
+  if (!rebuild)
+    return false;
+
+  if (multiprocessing_)
+    rebuildMultiThreaded(particleCells, cellCount);
+  else
+    rebuildSingleThreaded(particleCells, cellCount);
+
+  particleCells_ = particleCells;
+  rebuiltSize_ = indices_.size();
+  valid_ = true;
+  return true;
+}
+
+void CellList::rebuildMultiThreaded(const std::vector<uint32_t>& particleCells, uint32_t cellCount)
+{
+  const int n = particleCells.size();
+
+  const auto forEach = [](int begin, int end, auto f)
+  {
+    parallel::forEach(begin, end, f, true);
+  };
+
+  // Parallel histogram of particle cells
+  if (cellCounts_.size() != cellCount)
+    cellCounts_ = std::vector<std::atomic<uint32_t>>(cellCount);
+
+  forEach(0, cellCount, [&](int cell)
+    {
+      cellCounts_[cell].store(0, std::memory_order_relaxed);
+    });
+
+  forEach(0, n, [&](int i)
+    {
+      cellCounts_[particleCells[i]].fetch_add(1, std::memory_order_relaxed);
+    });
+
+  // Parallel exclusive prefix sum of cell capacities
+  cellStart_.resize(cellCount);
+  cellSizes_.resize(cellCount);
+  cellCapacities_.resize(cellCount);
+  const auto size = parallel::exclusiveScan<uint32_t>(cellCount,
+    [&](int cell)
+    {
+      const auto count = cellCounts_[cell].load(std::memory_order_relaxed);
+      return count + slack(count);
+    },
+    [&](int cell, uint32_t start)
+    {
+      const auto count = cellCounts_[cell].load(std::memory_order_relaxed);
+      cellStart_[cell] = start;
+      cellSizes_[cell] = count;
+      cellCapacities_[cell] = count + slack(count);
+
+      // Reuse counts as insertion cursors, as the scan reads each count before visiting it
+      cellCounts_[cell].store(start, std::memory_order_relaxed);
+    },
+    true);
+
+  // Parallel scatter of particle indices
+  indices_.resize(size);
+  particleSlots_.resize(n);
+  forEach(0, n, [&](int i)
+    {
+      indices_[cellCounts_[particleCells[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+    });
+
+  // Scatter order within a cell depends on thread scheduling, so sort to keep the order deterministic
+  forEach(0, cellCount, [&](int cell)
+    {
+      const auto begin = indices_.begin() + cellStart_[cell];
+      const auto end = begin + cellSizes_[cell];
+      std::sort(begin, end);
+
+      for (auto it = begin; it != end; ++it)
+        particleSlots_[*it] = it - indices_.begin();
+    });
+}
+
+void CellList::rebuildSingleThreaded(const std::vector<uint32_t>& particleCells, uint32_t cellCount)
+{
+  const int n = particleCells.size();
+
+  // Count particles per cell
+  cellSizes_.assign(cellCount, 0);
+  for (int i = 0; i < n; i++)
+    cellSizes_[particleCells[i]]++;
+
+  // Prefix sum of cell capacities
+  cellStart_.resize(cellCount);
+  cellCapacities_.resize(cellCount);
+  uint32_t size = 0;
+  for (int cell = 0; cell < cellCount; cell++)
+  {
+    const auto count = cellSizes_[cell];
+    cellStart_[cell] = size;
+    cellCapacities_[cell] = count + slack(count);
+    cellSizes_[cell] = 0;
+    size += cellCapacities_[cell];
+  }
+
+  // Scatter particle indices in index order, counting cell sizes again
+  indices_.resize(size);
+  particleSlots_.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    const auto cell = particleCells[i];
+    const auto slot = cellStart_[cell] + cellSizes_[cell]++;
+    indices_[slot] = i;
+    particleSlots_[i] = slot;
+  }
+}
+
+void CellList::moveChangedParticles(const std::vector<uint32_t>& particleCells)
+{
+  for (auto i : changed_)
+  {
+    const auto from = particleCells_[i];
+    const auto to = particleCells[i];
+
+    // Remove by moving the last particle of the cell to the vacated slot
+    const auto slot = particleSlots_[i];
+    const auto last = indices_[cellStart_[from] + --cellSizes_[from]];
+    indices_[slot] = last;
+    particleSlots_[last] = slot;
+
+    if (cellSizes_[to] == cellCapacities_[to])
+      grow(to);
+
+    const auto newSlot = cellStart_[to] + cellSizes_[to]++;
+    indices_[newSlot] = i;
+    particleSlots_[i] = newSlot;
+    particleCells_[i] = to;
+  }
+}
+
+void CellList::grow(uint32_t cell)
+{
+  const auto start = static_cast<uint32_t>(indices_.size());
+  const auto capacity = 2 * cellCapacities_[cell];
+  indices_.resize(start + capacity);
+
+  for (uint32_t k = 0; k < cellSizes_[cell]; k++)
+  {
+    const auto i = indices_[cellStart_[cell] + k];
+    indices_[start + k] = i;
+    particleSlots_[i] = start + k;
+  }
+
+  cellStart_[cell] = start;
+  cellCapacities_[cell] = capacity;
+}
+}
+}
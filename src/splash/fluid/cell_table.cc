@@ -0,0 +1,71 @@
+#include <splash/fluid/cell_table.h>
+
+namespace splash
+{
+namespace fluid
+{
+CellTable::CellTable() = default;
+
+CellTable::~CellTable() = default;
+
+void CellTable::clear(uint32_t cellCount)
+{
+  cells_.clear();
+  cells_.reserve(cellCount);
+
+  // At least twice as many entries as cells
+  uint32_t entryCount = 16;
+  while (entryCount < 2 * static_cast<uint64_t>(cellCount))
+    entryCount *= 2;
+  rehash(entryCount);
+}
+
+uint32_t CellTable::insert(const glm::ivec3& cell)
+{
+  if (entries_.empty() || 2 * (size() + 1) > entries_.size())
+    rehash(entries_.empty() ? 16 : 2 * entries_.size());
+
+  auto slot = hash(cell) & mask_;
+  for (; entries_[slot].id != notFound; slot = (slot + 1) & mask_)
+  {
+    if (entries_[slot].cell == cell)
+      return entries_[slot].id;
+  }
+
+  const auto id = size();
+  entries_[slot] = { cell, id };
+  cells_.push_back(cell);
+  return id;
+}
+
+float CellTable::displacedRate() const
+{
+  if (size() == 0)
+    return 0.f;
+
+  uint32_t displaced = 0;
+  for (uint32_t slot = 0; slot < entries_.size(); slot++)
+  {
+    const auto& entry = entries_[slot];
+    if (entry.id != notFound && (hash(entry.cell) & mask_) != slot)
+      displaced++;
+  }
+  return static_cast<float>(displaced) / size();
+}
+
+void CellTable::rehash(uint32_t entryCount)
+{
+  entries_.assign(entryCount, { glm::ivec3(0), notFound });
+  mask_ = entryCount - 1;
+
+  // Cells are inserted again by id, keeping their ids
+  for (uint32_t id = 0; id < size(); id++)
+  {
+    auto slot = hash(cells_[id]) & mask_;
+    while (entries_[slot].id != notFound)
+      slot = (slot + 1) & mask_;
+    entries_[slot] = { cells_[id], id };
+  }
+}
+}
+}
@@ -1,5 +1,16 @@
 #include <splash/fluid/neighbor_search.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include <tbb/tbb.h>
+
+#include <splash/geom/particles.h>
+#include <splash/parallel/primitives.h>
+
 namespace splash
 {
 namespace fluid
@@ -7,5 +18,311 @@ namespace fluid
 NeighborSearch::NeighborSearch() = default;
 
 NeighborSearch::~NeighborSearch() = default;
+
+bool NeighborSearch::updateNeighbors(const geom::Particles& particles, float h)
+{
+  assert(domain_.supportsRadius(h));
+
+  const auto n = particles.size();
+
+  auto rebuild = !valid_ || skin_ <= 0.f
+    || h != lastH_ || skin_ != lastSkin_ || symmetric_ != neighbors_.symmetric()
+    || boundaryNeighbors_ != lastBoundaryNeighbors_ || domain_ != lastDomain_
+    || n != lastPositions_.size();
+
+  // Two particles approaching each other by skin / 2 each may have entered h from outside h + skin
+  if (!rebuild)
+    rebuild = maxDisplacement(particles) > skin_ / 2.f;
+
+  if (!rebuild)
+    return false;
+
+  computeNeighbors(particles, h + std::max(skin_, 0.f));
+
+  valid_ = true;
+  lastH_ = h;
+  lastSkin_ = skin_;
+  lastBoundaryNeighbors_ = boundaryNeighbors_;
+  lastDomain_ = domain_;
+  lastPositions_.resize(n);
+  for (int i = 0; i < n; i++)
+    lastPositions_[i] = particles.position(i);
+
+  return true;
+}
+
+void NeighborSearch::computeVariableNeighbors(const geom::Particles& particles, const std::vector<float>& radii)
+{
+  const auto n = particles.size();
+
+  const auto h = n > 0 ? *std::max_element(radii.begin(), radii.begin() + n) : 0.f;
+  computeNeighbors(particles, h);
+
+  // Compaction in place, as no particle keeps more neighbors than before
+  auto& offsets = neighbors_.offsets();
+  auto& splits = neighbors_.splits();
+  auto& indices = neighbors_.indices();
+
+  uint32_t count = 0;
+  for (int i = 0; i < n; i++)
+  {
+    const auto begin = offsets[i];
+    const auto split = splits[i];
+    const auto end = offsets[i + 1];
+    offsets[i] = count;
+
+    const auto p0 = particles.position(i);
+    const auto compact = [&](uint32_t first, uint32_t last)
+    {
+      for (auto k = first; k < last; k++)
+      {
+        const auto j = indices[k];
+        const auto d = domain_.displacement(p0, particles.position(j));
+        const auto r = std::max(radii[i], radii[j]);
+        if (glm::dot(d, d) <= r * r)
+          indices[count++] = j;
+      }
+    };
+
+    // Fluid neighbors, then boundary neighbors
+    compact(begin, split);
+    splits[i] = count;
+    compact(split, end);
+  }
+  offsets[n] = count;
+  indices.resize(count);
+
+  statistics_.queryMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildFinish_).count();
+
+  if (statisticsEnabled_)
+    computeNeighborStatistics();
+}
+
+void NeighborSearch::queryRadius(const geom::Particles& particles, const std::vector<glm::vec3>& points, float radius, std::vector<std::vector<uint32_t>>& indices) const
+{
+  const int m = points.size();
+
+  indices.resize(m);
+  const auto query = [&](int q)
+  {
+    indices[q].clear();
+    queryPoint(particles, points[q], radius, indices[q]);
+  };
+
+  parallel::forEach(0, m, query, multiprocessing_);
+}
+
+void NeighborSearch::queryNearest(const geom::Particles& particles, const std::vector<glm::vec3>& points, int k, std::vector<std::vector<uint32_t>>& indices) const
+{
+  const int m = points.size();
+
+  indices.resize(m);
+  const auto query = [&](int q)
+  {
+    indices[q].clear();
+    queryNearestPoint(particles, points[q], k, indices[q]);
+  };
+
+  parallel::forEach(0, m, query, multiprocessing_);
+}
+
+void NeighborSearch::queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  queryAllParticles(particles, center, radius, indices);
+}
+
+void NeighborSearch::queryNearestPoint(const geom::Particles& particles, const glm::vec3& center, int k, std::vector<uint32_t>& indices) const
+{
+  const auto n = particles.size();
+  k = std::min<int>(k, n);
+  if (k <= 0)
+    return;
+
+  // All particles are within the radius before it overflows
+  constexpr int maxDoublings = 64;
+  auto radius = searchRadius_ > 0.f ? searchRadius_ : 1.f;
+  std::vector<uint32_t> candidates;
+  for (int i = 0; i < maxDoublings && candidates.size() < k; i++, radius *= 2.f)
+  {
+    candidates.clear();
+    queryPoint(particles, center, radius, candidates);
+  }
+
+  if (candidates.size() < k)
+  {
+    candidates.clear();
+    queryAllParticles(particles, center, std::numeric_limits<float>::infinity(), candidates);
+  }
+
+  keepNearest(particles, center, k, candidates);
+  indices.insert(indices.end(), candidates.begin(), candidates.end());
+}
+
+float NeighborSearch::queryMargin() const
+{
+  return valid_ ? std::max(skin_, 0.f) / 2.f : 0.f;
+}
+
+void NeighborSearch::queryAllParticles(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  const auto n = particles.size();
+
+  for (int i = 0; i < n; i++)
+  {
+    const auto d = domain_.displacement(center, particles.position(i));
+    if (glm::dot(d, d) <= radius * radius)
+      indices.push_back(i);
+  }
+}
+
+void NeighborSearch::keepNearest(const geom::Particles& particles, const glm::vec3& center, int k, std::vector<uint32_t>& indices) const
+{
+  std::vector<std::pair<float, uint32_t>> distances(indices.size());
+  for (int i = 0; i < indices.size(); i++)
+  {
+    const auto d = domain_.displacement(center, particles.position(indices[i]));
+    distances[i] = { glm::dot(d, d), indices[i] };
+  }
+
+  const auto count = std::min<size_t>(k, distances.size());
+  std::partial_sort(distances.begin(), distances.begin() + count, distances.end());
+
+  indices.resize(count);
+  for (int i = 0; i < count; i++)
+    indices[i] = distances[i].second;
+}
+
+float NeighborSearch::maxDisplacement(const geom::Particles& particles) const
+{
+  const auto n = particles.size();
+
+  const auto displacement2 = [&](int i)
+  {
+    const auto d = domain_.displacement(particles.position(i), lastPositions_[i]);
+    return glm::dot(d, d);
+  };
+
+  float maxDisplacement2 = 0.f;
+  if (multiprocessing_)
+  {
+    maxDisplacement2 = tbb::parallel_reduce(tbb::blocked_range<int>(0, n), 0.f,
+      [&](const tbb::blocked_range<int>& range, float value)
+      {
+        for (int i = range.begin(); i < range.end(); i++)
+          value = std::max(value, displacement2(i));
+        return value;
+      },
+      [](float a, float b) { return std::max(a, b); });
+  }
+  else
+  {
+    for (int i = 0; i < n; i++)
+      maxDisplacement2 = std::max(maxDisplacement2, displacement2(i));
+  }
+
+  return std::sqrt(maxDisplacement2);
+}
+
+void NeighborSearch::startBuild()
+{
+  statistics_ = Statistics();
+  buildStart_ = std::chrono::high_resolution_clock::now();
+  buildFinish_ = buildStart_;
+}
+
+void NeighborSearch::finishBuild()
+{
+  buildFinish_ = std::chrono::high_resolution_clock::now();
+  statistics_.buildMilliseconds = std::chrono::duration<double, std::milli>(buildFinish_ - buildStart_).count();
+}
+
+void NeighborSearch::addOccupiedCell(uint32_t particleCount)
+{
+  auto& particlesPerCell = statistics_.particlesPerCell;
+  particlesPerCell.resize(Statistics::maxParticlesPerCell);
+
+  statistics_.occupiedCells++;
+  particlesPerCell[std::min<uint32_t>(particleCount, Statistics::maxParticlesPerCell) - 1]++;
+}
+
+void NeighborSearch::computeNeighborStatistics()
+{
+  const auto n = neighbors_.particleCount();
+
+  // Neighbors of both particles of pairs listed once, so that each pair is counted twice
+  neighborCounts_.resize(n);
+  for (int i = 0; i < n; i++)
+    neighborCounts_[i] = neighbors_[i].size();
+
+  if (neighbors_.symmetric())
+  {
+    for (auto j : neighbors_.indices())
+      neighborCounts_[j]++;
+  }
+  else if (!boundaryNeighbors_)
+  {
+    // Boundary particles are not queried, so fluid-boundary pairs are listed only under the fluid particle
+    for (int i = 0; i < n; i++)
+    {
+      for (auto j : neighbors_.boundary(i))
+        neighborCounts_[j]++;
+    }
+  }
+
+  const auto total = std::accumulate(neighborCounts_.begin(), neighborCounts_.end(), uint64_t(0));
+  statistics_.pairCount = total / 2;
+  statistics_.minNeighbors = n > 0 ? *std::min_element(neighborCounts_.begin(), neighborCounts_.end()) : 0;
+  statistics_.maxNeighbors = n > 0 ? *std::max_element(neighborCounts_.begin(), neighborCounts_.end()) : 0;
+  statistics_.meanNeighbors = n > 0 ? static_cast<float>(total) / n : 0.f;
+}
+
+bool NeighborSearch::queried(const geom::Particles& particles, int i) const
+{
+  return boundaryNeighbors_ || symmetric_ || particles.type(i) == geom::ParticleType::FLUID;
+}
+
+void NeighborSearch::collectNeighbors(const geom::Particles& particles, std::vector<std::vector<uint32_t>>& neighborsPerParticle)
+{
+  const int n = neighborsPerParticle.size();
+
+  auto& offsets = neighbors_.offsets();
+  auto& splits = neighbors_.splits();
+  auto& indices = neighbors_.indices();
+
+  // Fluid neighbors first, dropping boundary-boundary pairs unless requested
+  fluidCounts_.resize(n);
+  const auto partition = [&](int i)
+  {
+    auto& neighbors = neighborsPerParticle[i];
+    const auto split = std::partition(neighbors.begin(), neighbors.end(),
+      [&](uint32_t j) { return particles.type(j) == geom::ParticleType::FLUID; });
+    fluidCounts_[i] = split - neighbors.begin();
+
+    if (!boundaryNeighbors_ && particles.type(i) == geom::ParticleType::BOUNDARY)
+      neighbors.erase(split, neighbors.end());
+  };
+
+  parallel::forEach(0, n, partition, multiprocessing_);
+
+  // Exclusive prefix sum of neighbor counts, then each particle copies to its own offset
+  offsets.resize(n + 1);
+  splits.resize(n);
+  offsets[n] = parallel::exclusiveScan<uint32_t>(n,
+    [&](int i) { return static_cast<uint32_t>(neighborsPerParticle[i].size()); },
+    [&](int i, uint32_t offset) { offsets[i] = offset; },
+    multiprocessing_);
+
+  indices.resize(offsets[n]);
+  parallel::forEach(0, n, [&](int i)
+    {
+      std::copy(neighborsPerParticle[i].begin(), neighborsPerParticle[i].end(), indices.begin() + offsets[i]);
+      splits[i] = offsets[i] + fluidCounts_[i];
+    }, multiprocessing_);
+
+  statistics_.queryMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildFinish_).count();
+
+  if (statisticsEnabled_)
+    computeNeighborStatistics();
+}
 }
 }
@@ -0,0 +1,67 @@
+#include <splash/fluid/neighbor_search_benchmark.h>
+
+#include <chrono>
+#include <iomanip>
+
+#include <tbb/tbb.h>
+
+#include <splash/fluid/neighbor_search.h>
+#include <splash/geom/particles.h>
+
+namespace splash
+{
+namespace fluid
+{
+NeighborSearchBenchmark::NeighborSearchBenchmark() = default;
+
+NeighborSearchBenchmark::~NeighborSearchBenchmark() = default;
+
+void NeighborSearchBenchmark::measureScaling(NeighborSearch& neighborSearch, const geom::Particles& particles, float h)
+{
+  timings_.clear();
+
+  const auto maxThreads = tbb::this_task_arena::max_concurrency();
+
+  std::vector<int> threadCounts;
+  for (int threads = 1; threads < maxThreads; threads *= 2)
+    threadCounts.push_back(threads);
+  threadCounts.push_back(maxThreads);
+
+  neighborSearch.setMultiprocessing(true);
+  for (auto threads : threadCounts)
+  {
+    tbb::task_arena arena(threads);
+
+    Timing timing;
+    timing.threads = threads;
+    arena.execute([&]
+      {
+        // Warm up caches and scratch buffers
+        neighborSearch.computeNeighbors(particles, h);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < repeats_; i++)
+          neighborSearch.computeNeighbors(particles, h);
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        timing.milliseconds = std::chrono::duration<double, std::milli>(end - start).count() / repeats_;
+      });
+
+    timing.speedup = timings_.empty() ? 1. : timings_[0].milliseconds / timing.milliseconds;
+    timings_.push_back(timing);
+  }
+}
+
+void NeighborSearchBenchmark::printReport(std::ostream& out, const std::string& name) const
+{
+  out << name << " scaling report" << std::endl;
+  out << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "speedup" << std::endl;
+  for (const auto& timing : timings_)
+  {
+    out << std::setw(8) << timing.threads
+      << std::setw(12) << std::fixed << std::setprecision(3) << timing.milliseconds
+      << std::setw(9) << std::setprecision(2) << timing.speedup << "x" << std::endl;
+  }
+}
+}
+}
@@ -0,0 +1,113 @@
+#include <splash/fluid/neighbor_search_bvh.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <tbb/tbb.h>
+
+#include <splash/geom/particles.h>
+
+namespace splash
+{
+namespace fluid
+{
+NeighborSearchBvh::NeighborSearchBvh()
+  : NeighborSearch()
+{
+}
+
+NeighborSearchBvh::~NeighborSearchBvh()
+{
+}
+
+void NeighborSearchBvh::computeNeighbors(const geom::Particles& particles, float h)
+{
+  const auto n = particles.size();
+
+  startBuild();
+  searchRadius_ = h;
+  bvh_.setMultiprocessing(multiprocessing_);
+  bvh_.construct(particles);
+  finishBuild();
+
+  // Symmetric search visits leaves in morton order, each taking pairs with the leaves after it,
+  // so subtrees of earlier leaves are pruned
+  neighbors_.setSymmetric(symmetric_);
+  neighborsPerParticle_.resize(n);
+  const auto search = [&](int k)
+  {
+    const auto i = symmetric_ ? bvh_.leafParticle(k) : k;
+    auto& neighbors = neighborsPerParticle_[i];
+    neighbors.clear();
+    if (!queried(particles, i))
+      return;
+
+    if (symmetric_)
+      bvh_.queryFollowingLeaves(k, h, neighbors);
+    else
+    {
+      bvh_.query(particles.position(i), h, neighbors);
+      neighbors.erase(std::remove(neighbors.begin(), neighbors.end(), i), neighbors.end());
+    }
+  };
+
+  if (multiprocessing_)
+  {
+    tbb::parallel_for(tbb::blocked_range<int>(0, n),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        for (int i = range.begin(); i < range.end(); i++)
+          search(i);
+      });
+  }
+  else
+  {
+    for (int i = 0; i < n; i++)
+      search(i);
+  }
+
+  collectNeighbors(particles, neighborsPerParticle_);
+}
+
+void NeighborSearchBvh::queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  // The tree has positions of the last build, within the margin of current positions
+  const auto begin = indices.size();
+  bvh_.query(center, radius + queryMargin(), indices);
+
+  const auto end = std::remove_if(indices.begin() + begin, indices.end(), [&](uint32_t i)
+    {
+      const auto p = particles.position(i);
+      return glm::dot(center - p, center - p) > radius * radius;
+    });
+  indices.erase(end, indices.end());
+}
+
+void NeighborSearchBvh::queryNearestPoint(const geom::Particles& particles, const glm::vec3& center, int k, std::vector<uint32_t>& indices) const
+{
+  if (queryMargin() == 0.f)
+  {
+    bvh_.nearest(center, k, indices);
+    return;
+  }
+
+  // The k nearest at positions of the last build bound the distance of the k nearest at current positions
+  std::vector<uint32_t> candidates;
+  bvh_.nearest(center, k, candidates);
+
+  float radius2 = 0.f;
+  for (auto i : candidates)
+  {
+    const auto p = particles.position(i);
+    radius2 = std::max(radius2, glm::dot(center - p, center - p));
+  }
+
+  // Rounded up, so that the square of the radius is not below the farthest distance
+  candidates.clear();
+  queryPoint(particles, center, std::nextafter(std::sqrt(radius2), std::numeric_limits<float>::infinity()), candidates);
+  keepNearest(particles, center, k, candidates);
+  indices.insert(indices.end(), candidates.begin(), candidates.end());
+}
+}
+}
@@ -0,0 +1,304 @@
+#include <splash/fluid/neighbor_search_multi_level_grid.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include <tbb/tbb.h>
+
+#include <splash/geom/particles.h>
+#include <splash/parallel/primitives.h>
+
+namespace splash
+{
+namespace fluid
+{
+namespace
+{
+// Lower bound by exponential search forward from first, for values near first
+template <typename Iterator, typename T>
+Iterator lowerBoundFrom(Iterator first, Iterator last, const T& value)
+{
+  for (std::ptrdiff_t step = 1; last - first > step; step *= 2)
+  {
+    const auto probe = first + step;
+    if (!(*probe < value))
+      return std::lower_bound(first, probe, value);
+    first = probe + 1;
+  }
+  return std::lower_bound(first, last, value);
+}
+}
+
+NeighborSearchMultiLevelGrid::NeighborSearchMultiLevelGrid()
+  : NeighborSearch()
+{
+}
+
+NeighborSearchMultiLevelGrid::~NeighborSearchMultiLevelGrid()
+{
+}
+
+void NeighborSearchMultiLevelGrid::computeNeighbors(const geom::Particles& particles, float h)
+{
+  uniformRadii_.assign(particles.size(), h);
+  computeVariableNeighbors(particles, uniformRadii_);
+}
+
+void NeighborSearchMultiLevelGrid::computeVariableNeighbors(const geom::Particles& particles, const std::vector<float>& radii)
+{
+  const auto n = particles.size();
+
+  startBuild();
+  neighbors_.setSymmetric(symmetric_);
+  if (n == 0)
+  {
+    neighbors_.reset(0);
+    return;
+  }
+
+  assignLevels(particles, radii);
+  searchRadius_ = cellSize_;
+  sortByCell(particles);
+  finishBuild();
+
+  // Pairs of the same level from both particles, or once if symmetric.
+  // Pairs of different levels from the finer particle, and also from the coarser one unless symmetric.
+  neighborsPerParticle_.resize(n);
+  if (multiprocessing_)
+  {
+    tbb::parallel_for(tbb::blocked_range<int>(0, n),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        for (int i = range.begin(); i < range.end(); i++)
+          findNeighbors(particles, radii, i);
+      });
+  }
+  else
+  {
+    for (int i = 0; i < n; i++)
+      findNeighbors(particles, radii, i);
+  }
+
+  collectNeighbors(particles, neighborsPerParticle_);
+
+  // Runs of equal keys are cells
+  if (statisticsEnabled_)
+  {
+    for (int begin = 0, end = 0; begin < n; begin = end)
+    {
+      while (end < n && sortedCells_[end].first == sortedCells_[begin].first)
+        end++;
+      addOccupiedCell(end - begin);
+    }
+  }
+}
+
+void NeighborSearchMultiLevelGrid::assignLevels(const geom::Particles& particles, const std::vector<float>& radii)
+{
+  const int n = particles.size();
+
+  // Bounding box and smallest radius
+  struct Bounds
+  {
+    glm::vec3 min;
+    glm::vec3 max;
+    float minRadius;
+  };
+
+  const auto extend = [&](const tbb::blocked_range<int>& range, Bounds bounds)
+  {
+    for (int i = range.begin(); i < range.end(); i++)
+    {
+      const auto p = particles.position(i);
+      bounds.min = glm::min(bounds.min, p);
+      bounds.max = glm::max(bounds.max, p);
+      bounds.minRadius = std::min(bounds.minRadius, radii[i]);
+    }
+    return bounds;
+  };
+
+  const Bounds initial{ particles.position(0), particles.position(0), radii[0] };
+  Bounds bounds;
+  if (multiprocessing_)
+  {
+    bounds = tbb::parallel_reduce(tbb::blocked_range<int>(0, n), initial, extend,
+      [](const Bounds& a, const Bounds& b) { return Bounds{ glm::min(a.min, b.min), glm::max(a.max, b.max), std::min(a.minRadius, b.minRadius) }; });
+  }
+  else
+    bounds = extend(tbb::blocked_range<int>(0, n), initial);
+
+  // Finest cells as large as the smallest radius, unless cell coordinates would not fit in their bits
+  min_ = bounds.min;
+  const auto extent = bounds.max - bounds.min;
+  const auto maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+  cellSize_ = std::max(bounds.minRadius, maxExtent / ((1 << cellBits_) - 1));
+  if (!(cellSize_ > 0.f))
+    cellSize_ = 1.f;
+
+  // The level of a particle is the finest one with cells at least as large as its radius
+  particleLevels_.resize(n);
+  parallel::forEach(0, n, [&](int i)
+    {
+      int level = 0;
+      while (level < maxLevels_ - 1 && std::ldexp(cellSize_, level) < radii[i])
+        level++;
+      particleLevels_[i] = level;
+    }, multiprocessing_);
+
+  // Largest radius of each level
+  using LevelRadii = std::array<float, maxLevels_>;
+  const auto extendRadii = [&](const tbb::blocked_range<int>& range, LevelRadii levelRadii)
+  {
+    for (int i = range.begin(); i < range.end(); i++)
+      levelRadii[particleLevels_[i]] = std::max(levelRadii[particleLevels_[i]], radii[i]);
+    return levelRadii;
+  };
+
+  LevelRadii levelRadii{};
+  if (multiprocessing_)
+  {
+    levelRadii = tbb::parallel_reduce(tbb::blocked_range<int>(0, n), levelRadii, extendRadii,
+      [](LevelRadii a, const LevelRadii& b)
+      {
+        for (int level = 0; level < maxLevels_; level++)
+          a[level] = std::max(a[level], b[level]);
+        return a;
+      });
+  }
+  else
+    levelRadii = extendRadii(tbb::blocked_range<int>(0, n), levelRadii);
+
+  // Radii of coarser levels are above the cells of the level below, so only the finest level may have a zero radius
+  levelRadius_.assign(levelRadii.begin(), levelRadii.end());
+  levelCount_ = 1;
+  for (int level = 1; level < maxLevels_; level++)
+  {
+    if (levelRadius_[level] > 0.f)
+      levelCount_ = level + 1;
+  }
+}
+
+void NeighborSearchMultiLevelGrid::sortByCell(const geom::Particles& particles)
+{
+  const auto n = particles.size();
+
+  sortedCells_.resize(n);
+  parallel::forEach(0, n, [&](int i)
+    {
+      const auto level = particleLevels_[i];
+      sortedCells_[i] = { cellKey(level, cellCoordinate(particles.position(i), level)), i };
+    }, multiprocessing_);
+
+  if (multiprocessing_)
+    tbb::parallel_sort(sortedCells_.begin(), sortedCells_.end());
+  else
+    std::sort(sortedCells_.begin(), sortedCells_.end());
+}
+
+void NeighborSearchMultiLevelGrid::findNeighbors(const geom::Particles& particles, const std::vector<float>& radii, int i)
+{
+  auto& neighbors = neighborsPerParticle_[i];
+  neighbors.clear();
+  if (!queried(particles, i))
+    return;
+
+  const auto p0 = particles.position(i);
+  const auto r0 = radii[i];
+  const auto level0 = particleLevels_[i];
+
+  // Rows of cells are visited in increasing key order, so each is searched from the end of the previous one
+  auto rowBegin = sortedCells_.begin();
+
+  // Finer levels only in full lists, where pairs of different levels are found from both particles
+  for (int level = symmetric_ ? level0 : 0; level < levelCount_; level++)
+  {
+    // Within the largest radius of both, which covers 27 cells for any coarser level, and is r0 for finer levels
+    const auto r = std::max(r0, levelRadius_[level]);
+    const auto cellMin = cellCoordinate(p0 - r, level);
+    const auto cellMax = cellCoordinate(p0 + r, level);
+
+    for (uint32_t x = cellMin.x; x <= cellMax.x; x++)
+    {
+      for (uint32_t y = cellMin.y; y <= cellMax.y; y++)
+      {
+        // Cells along z are contiguous in the sorted order
+        const auto keyEnd = cellKey(level, { x, y, cellMax.z });
+        auto it = lowerBoundFrom(rowBegin, sortedCells_.end(), std::make_pair(cellKey(level, { x, y, cellMin.z }), 0u));
+        for (; it != sortedCells_.end() && it->first <= keyEnd; ++it)
+        {
+          const auto i1 = it->second;
+          if (level == level0 && (symmetric_ ? i1 <= i : i1 == i))
+            continue;
+
+          const auto p1 = particles.position(i1);
+          const auto r01 = std::max(r0, radii[i1]);
+          if (glm::dot(p0 - p1, p0 - p1) <= r01 * r01)
+            neighbors.push_back(i1);
+        }
+        rowBegin = it;
+      }
+    }
+  }
+}
+
+void NeighborSearchMultiLevelGrid::queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  if (particles.size() == 0 || sortedCells_.empty())
+    return;
+
+  // Cells overlapping the query box at positions of the last build, on every level
+  const auto r = radius + queryMargin();
+  double cellCount = 0.;
+  for (int level = 0; level < levelCount_; level++)
+  {
+    const auto extent = glm::vec3(cellCoordinate(center + r, level) - cellCoordinate(center - r, level)) + 1.f;
+    cellCount += static_cast<double>(extent.x) * extent.y;
+  }
+
+  // Each row of cells along z is one binary search
+  if (cellCount > particles.size())
+  {
+    queryAllParticles(particles, center, radius, indices);
+    return;
+  }
+
+  for (int level = 0; level < levelCount_; level++)
+  {
+    const auto cellMin = cellCoordinate(center - r, level);
+    const auto cellMax = cellCoordinate(center + r, level);
+
+    for (uint32_t x = cellMin.x; x <= cellMax.x; x++)
+    {
+      for (uint32_t y = cellMin.y; y <= cellMax.y; y++)
+      {
+        const auto keyEnd = cellKey(level, { x, y, cellMax.z });
+        auto it = std::lower_bound(sortedCells_.begin(), sortedCells_.end(), std::make_pair(cellKey(level, { x, y, cellMin.z }), 0u));
+        for (; it != sortedCells_.end() && it->first <= keyEnd; ++it)
+        {
+          const auto i = it->second;
+          const auto p = particles.position(i);
+          if (glm::dot(center - p, center - p) <= radius * radius)
+            indices.push_back(i);
+        }
+      }
+    }
+  }
+}
+
+glm::uvec3 NeighborSearchMultiLevelGrid::cellCoordinate(const glm::vec3& p, int level) const
+{
+  constexpr auto maxCoordinate = static_cast<float>((1 << cellBits_) - 1);
+  const auto cell = glm::floor((p - min_) / std::ldexp(cellSize_, level));
+  return glm::uvec3(glm::clamp(cell, glm::vec3(0.f), glm::vec3(maxCoordinate)));
+}
+
+uint64_t NeighborSearchMultiLevelGrid::cellKey(int level, const glm::uvec3& cell)
+{
+  return static_cast<uint64_t>(level) << (3 * cellBits_)
+    | static_cast<uint64_t>(cell.x) << (2 * cellBits_)
+    | static_cast<uint64_t>(cell.y) << cellBits_
+    | cell.z;
+}
+}
+}
@@ -1,5 +1,11 @@
 #include <splash/fluid/neighbor_search_naive.h>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <tbb/tbb.h>
+
 #include <splash/geom/particles.h>
 
 namespace splash
@@ -17,12 +23,103 @@ NeighborSearchNaive::~NeighborSearchNaive()
 
 void NeighborSearchNaive::computeNeighbors(const geom::Particles& particles, float h)
 {
-  const auto n = particles.size();
+  const int n = particles.size();
+
+  startBuild();
+  searchRadius_ = h;
+  finishBuild(); // Particle coordinate arrays are searched directly
+
+  neighborsPerParticle_.resize(n);
+  for (auto& neighbors : neighborsPerParticle_)
+    neighbors.clear();
 
-  for (int i = 0; i < n; i++)
+  // Blocks of particles i are tested against blocks of candidates, in increasing candidate order.
+  // Symmetric search takes candidates with larger index only.
+  neighbors_.setSymmetric(symmetric_);
+  const auto blockCount = (n + blockSize_ - 1) / blockSize_;
+  const auto searchBlock = [&](int block)
   {
-    for (int j = i + 1; j < n; j++)
+    const auto begin = block * blockSize_;
+    const auto end = std::min(begin + blockSize_, n);
+
+    for (int candidateBegin = symmetric_ ? begin : 0; candidateBegin < n; candidateBegin += blockSize_)
+    {
+      const auto candidateEnd = std::min(candidateBegin + blockSize_, n);
+      for (int i = begin; i < end; i++)
+      {
+        const auto first = symmetric_ ? std::max(candidateBegin, i + 1) : candidateBegin;
+        if (first < candidateEnd && queried(particles, i))
+          findNeighborsInBlock(particles, i, first, candidateEnd, h, neighborsPerParticle_[i]);
+      }
+    }
+  };
+
+  if (multiprocessing_)
+  {
+    tbb::parallel_for(tbb::blocked_range<int>(0, blockCount, 1),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        for (int block = range.begin(); block < range.end(); block++)
+          searchBlock(block);
+      });
+  }
+  else
+  {
+    for (int block = 0; block < blockCount; block++)
+      searchBlock(block);
+  }
+
+  collectNeighbors(particles, neighborsPerParticle_);
+}
+
+void NeighborSearchNaive::findNeighborsInBlock(const geom::Particles& particles, int i, int begin, int end, float h, std::vector<uint32_t>& neighbors)
+{
+  const auto* x = particles.x().data();
+  const auto* y = particles.y().data();
+  const auto* z = particles.z().data();
+
+  const auto px = x[i];
+  const auto py = y[i];
+  const auto pz = z[i];
+  const auto h2 = h * h;
+
+  // Branch-free distance test, vectorized by the compiler
+  std::array<uint8_t, blockSize_> inside;
+  const auto count = end - begin;
+  if (domain_.enabled())
+  {
+    const glm::vec3 p(px, py, pz);
+    for (int j = 0; j < count; j++)
+    {
+      const auto d = domain_.displacement(p, glm::vec3(x[begin + j], y[begin + j], z[begin + j]));
+      inside[j] = glm::dot(d, d) <= h2;
+    }
+  }
+  else
+  {
+    for (int j = 0; j < count; j++)
+    {
+      const auto dx = px - x[begin + j];
+      const auto dy = py - y[begin + j];
+      const auto dz = pz - z[begin + j];
+      inside[j] = dx * dx + dy * dy + dz * dz <= h2;
+    }
+  }
+
+  // Survivors are rare, so skip 8 results at a time
+  const auto wordCount = (count + 7) / 8;
+  std::fill(inside.begin() + count, inside.begin() + wordCount * 8, 0);
+  for (int word = 0; word < wordCount; word++)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, inside.data() + word * 8, sizeof(bits));
+    if (bits == 0)
+      continue;
+
+    for (int j = word * 8; j < word * 8 + 8; j++)
     {
+      if (inside[j] && begin + j != i)
+        neighbors.push_back(begin + j);
     }
   }
 }
@@ -0,0 +1,325 @@
+#include <splash/fluid/neighbor_search_sparse_grid.h>
+
+#include <cmath>
+
+#include <tbb/tbb.h>
+
+#include <splash/geom/particles.h>
+
+namespace splash
+{
+namespace fluid
+{
+namespace
+{
+bool isForward(const glm::ivec3& offset)
+{
+  return offset.x > 0 || (offset.x == 0 && offset.y > 0) || (offset.x == 0 && offset.y == 0 && offset.z > 0);
+}
+}
+
+NeighborSearchSparseGrid::NeighborSearchSparseGrid()
+  : NeighborSearch()
+{
+}
+
+NeighborSearchSparseGrid::~NeighborSearchSparseGrid()
+{
+}
+
+void NeighborSearchSparseGrid::computeNeighbors(const geom::Particles& particles, float h)
+{
+  const auto n = particles.size();
+
+  startBuild();
+  searchRadius_ = h;
+  h_ = h;
+  buildBricks(particles, h);
+  finishBuild();
+
+  neighbors_.setSymmetric(symmetric_);
+  neighborsPerParticle_.resize(n);
+  if (multiprocessing_)
+  {
+    tbb::parallel_for(tbb::blocked_range<uint32_t>(0, brickCount_, 1),
+      [&](const tbb::blocked_range<uint32_t>& range)
+      {
+        for (auto brick = range.begin(); brick < range.end(); brick++)
+          findNeighborsInBrick(particles, h, brick);
+      });
+  }
+  else
+  {
+    for (uint32_t brick = 0; brick < brickCount_; brick++)
+      findNeighborsInBrick(particles, h, brick);
+  }
+
+  collectNeighbors(particles, neighborsPerParticle_);
+
+  if (statisticsEnabled_)
+  {
+    for (uint32_t b = 0; b < brickCount_; b++)
+    {
+      const auto& brick = bricks_[b];
+      for (int cell = 0; cell < cellsPerBrick_; cell++)
+      {
+        if (occupied(brick, cell))
+          addOccupiedCell(brick.cellStart[cell + 1] - brick.cellStart[cell]);
+      }
+    }
+  }
+}
+
+void NeighborSearchSparseGrid::buildBricks(const geom::Particles& particles, float h)
+{
+  const auto n = particles.size();
+
+  particleCells_.resize(n);
+  particleBricks_.resize(n);
+  if (multiprocessing_)
+  {
+    tbb::parallel_for(tbb::blocked_range<int>(0, n),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        for (int i = range.begin(); i < range.end(); i++)
+          particleCells_[i] = cellCoordinate(particles.position(i), h);
+      });
+  }
+  else
+  {
+    for (int i = 0; i < n; i++)
+      particleCells_[i] = cellCoordinate(particles.position(i), h);
+  }
+
+  // Bricks are taken from the pool on first use, and particles are counted per cell
+  brickIndices_.clear();
+  brickCount_ = 0;
+  for (int i = 0; i < n; i++)
+  {
+    const auto& cell = particleCells_[i];
+    const auto coordinate = cell >> brickBits_;
+    const auto inserted = brickIndices_.emplace(brickKey(coordinate), brickCount_);
+    if (inserted.second)
+    {
+      if (brickCount_ == bricks_.size())
+        bricks_.emplace_back();
+
+      auto& brick = bricks_[brickCount_++];
+      brick.coordinate = coordinate;
+      brick.cellStart.fill(0);
+    }
+
+    const auto brick = inserted.first->second;
+    particleBricks_[i] = brick;
+    bricks_[brick].cellStart[cellIndex(cell & (brickSide_ - 1)) + 1]++;
+  }
+
+  // Cell offsets and occupancy within bricks, and brick offsets
+  uint32_t begin = 0;
+  for (uint32_t b = 0; b < brickCount_; b++)
+  {
+    auto& brick = bricks_[b];
+    brick.begin = begin;
+    brick.occupancy.fill(0);
+    for (int cell = 0; cell < cellsPerBrick_; cell++)
+    {
+      if (brick.cellStart[cell + 1] > 0)
+        brick.occupancy[cell / 64] |= uint64_t(1) << (cell % 64);
+      brick.cellStart[cell + 1] += brick.cellStart[cell];
+    }
+    begin += brick.cellStart[cellsPerBrick_];
+  }
+
+  // Scatter particle indices, using cellStart as insertion cursors and then shifting back
+  sortedIndices_.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    auto& brick = bricks_[particleBricks_[i]];
+    const auto cell = cellIndex(particleCells_[i] & (brickSide_ - 1));
+    sortedIndices_[brick.begin + brick.cellStart[cell]++] = i;
+  }
+
+  for (uint32_t b = 0; b < brickCount_; b++)
+  {
+    auto& cellStart = bricks_[b].cellStart;
+    for (int cell = cellsPerBrick_; cell > 0; cell--)
+      cellStart[cell] = cellStart[cell - 1];
+    cellStart[0] = 0;
+  }
+}
+
+void NeighborSearchSparseGrid::findNeighborsInBrick(const geom::Particles& particles, float h, uint32_t brickIndex)
+{
+  const auto& brick = bricks_[brickIndex];
+
+  // Bricks around this brick, which contain all cells near its cells
+  std::array<int, 27> nearbyBricks;
+  for (int i = 0; i < 27; i++)
+  {
+    const auto offset = glm::ivec3(i / 9, i / 3 % 3, i % 3) - 1;
+    const auto it = brickIndices_.find(brickKey(brick.coordinate + offset));
+    nearbyBricks[i] = it == brickIndices_.end() ? -1 : static_cast<int>(it->second);
+  }
+
+  struct CellRange
+  {
+    const uint32_t* begin;
+    const uint32_t* end;
+    bool home;
+  };
+
+  for (int cell = 0; cell < cellsPerBrick_; cell++)
+  {
+    if (!occupied(brick, cell))
+      continue;
+
+    const glm::ivec3 local(cell >> (2 * brickBits_), (cell >> brickBits_) & (brickSide_ - 1), cell & (brickSide_ - 1));
+
+    // Particle ranges of occupied cells nearby, with the half stencil if symmetric
+    std::array<CellRange, 27> ranges;
+    int rangeCount = 0;
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        for (int dz = -1; dz <= 1; dz++)
+        {
+          const glm::ivec3 offset(dx, dy, dz);
+          const auto home = offset == glm::ivec3(0);
+          if (symmetric_ && !home && !isForward(offset))
+            continue;
+
+          const auto nearbyLocal = local + offset + brickSide_;
+          const auto brickOffset = nearbyLocal / brickSide_;
+          const auto nearbyBrick = nearbyBricks[brickOffset.x * 9 + brickOffset.y * 3 + brickOffset.z];
+          if (nearbyBrick < 0)
+            continue;
+
+          const auto& nearby = bricks_[nearbyBrick];
+          const auto nearbyCell = cellIndex(nearbyLocal % brickSide_);
+          if (!occupied(nearby, nearbyCell))
+            continue;
+
+          const auto* indices = sortedIndices_.data() + nearby.begin;
+          ranges[rangeCount++] = { indices + nearby.cellStart[nearbyCell], indices + nearby.cellStart[nearbyCell + 1], home };
+        }
+      }
+    }
+
+    for (auto k = brick.cellStart[cell]; k < brick.cellStart[cell + 1]; k++)
+    {
+      const auto i = sortedIndices_[brick.begin + k];
+      const auto p0 = particles.position(i);
+
+      auto& neighbors = neighborsPerParticle_[i];
+      neighbors.clear();
+      if (!queried(particles, i))
+        continue;
+
+      for (int r = 0; r < rangeCount; r++)
+      {
+        const auto& range = ranges[r];
+        for (const auto* it = range.begin; it != range.end; ++it)
+        {
+          const auto i1 = *it;
+          if ((symmetric_ && range.home) ? i1 > i : i1 != i)
+          {
+            const auto p1 = particles.position(i1);
+            if (glm::dot(p0 - p1, p0 - p1) <= h * h)
+              neighbors.push_back(i1);
+          }
+        }
+      }
+    }
+  }
+}
+
+void NeighborSearchSparseGrid::queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  if (particles.size() == 0 || brickCount_ == 0)
+    return;
+
+  // Cells overlapping the query box at positions of the last build, clamped as particle cells are
+  constexpr auto maxCoordinate = static_cast<float>(maxCellCoordinate_);
+  const auto r = radius + queryMargin();
+  const auto lower = glm::clamp(glm::floor((center - r) / h_), glm::vec3(-maxCoordinate - 1.f), glm::vec3(maxCoordinate));
+  const auto upper = glm::clamp(glm::floor((center + r) / h_), glm::vec3(-maxCoordinate - 1.f), glm::vec3(maxCoordinate));
+  const auto extent = upper - lower + 1.f;
+  const auto cellCount = static_cast<double>(extent.x) * extent.y * extent.z;
+  if (!(cellCount <= particles.size()))
+  {
+    queryAllParticles(particles, center, radius, indices);
+    return;
+  }
+
+  // Bricks overlapping the cells, and their cells within the range
+  const auto cellMin = glm::ivec3(lower);
+  const auto cellMax = glm::ivec3(upper);
+  const auto brickMin = cellMin >> brickBits_;
+  const auto brickMax = cellMax >> brickBits_;
+  for (int bx = brickMin.x; bx <= brickMax.x; bx++)
+  {
+    for (int by = brickMin.y; by <= brickMax.y; by++)
+    {
+      for (int bz = brickMin.z; bz <= brickMax.z; bz++)
+      {
+        const glm::ivec3 coordinate(bx, by, bz);
+        const auto it = brickIndices_.find(brickKey(coordinate));
+        if (it == brickIndices_.end())
+          continue;
+
+        const auto& brick = bricks_[it->second];
+        const auto* sortedIndices = sortedIndices_.data() + brick.begin;
+        const auto localMin = glm::max(cellMin - coordinate * brickSide_, glm::ivec3(0));
+        const auto localMax = glm::min(cellMax - coordinate * brickSide_, glm::ivec3(brickSide_ - 1));
+        for (int x = localMin.x; x <= localMax.x; x++)
+        {
+          for (int y = localMin.y; y <= localMax.y; y++)
+          {
+            for (int z = localMin.z; z <= localMax.z; z++)
+            {
+              const auto cell = cellIndex({ x, y, z });
+              if (!occupied(brick, cell))
+                continue;
+
+              for (auto k = brick.cellStart[cell]; k < brick.cellStart[cell + 1]; k++)
+              {
+                const auto i = sortedIndices[k];
+                const auto p = particles.position(i);
+                if (glm::dot(center - p, center - p) <= radius * radius)
+                  indices.push_back(i);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+glm::ivec3 NeighborSearchSparseGrid::cellCoordinate(const glm::vec3& p, float h) const
+{
+  constexpr auto maxCoordinate = static_cast<float>(maxCellCoordinate_);
+  const auto cell = glm::floor(p / h);
+  return glm::ivec3(glm::clamp(cell, glm::vec3(-maxCoordinate - 1.f), glm::vec3(maxCoordinate)));
+}
+
+uint64_t NeighborSearchSparseGrid::brickKey(const glm::ivec3& brick)
+{
+  constexpr uint64_t mask = (1 << 21) - 1;
+  return (static_cast<uint64_t>(brick.x) & mask) << 42
+    | (static_cast<uint64_t>(brick.y) & mask) << 21
+    | (static_cast<uint64_t>(brick.z) & mask);
+}
+
+int NeighborSearchSparseGrid::cellIndex(const glm::ivec3& local)
+{
+  return (local.x << (2 * brickBits_)) | (local.y << brickBits_) | local.z;
+}
+
+bool NeighborSearchSparseGrid::occupied(const Brick& brick, int cell)
+{
+  return (brick.occupancy[cell / 64] >> (cell % 64)) & 1;
+}
+}
+}
@@ -1,11 +1,11 @@
 #include <splash/fluid/neighbor_search_spatial_hashing.h>
 
-#include <set>
-#include <functional>
-
-#include <tbb/tbb.h>
+#include <array>
+#include <algorithm>
+#include <cmath>
 
 #include <splash/geom/particles.h>
+#include <splash/parallel/primitives.h>
 
 namespace splash
 {
@@ -13,14 +13,26 @@ namespace fluid
 {
 namespace
 {
-void forEach(int begin, int end, std::function<void(int)> f)
+// Cell offsets lexicographically greater than (0, 0, 0), covering each pair of adjacent cells once
+const std::vector<glm::ivec3>& forwardCellOffsets()
 {
-  tbb::parallel_for(tbb::blocked_range<int>(begin, end),
-    [&](const tbb::blocked_range<int>& range)
+  static const std::vector<glm::ivec3> offsets = []
+  {
+    std::vector<glm::ivec3> offsets;
+    for (int dx = -1; dx <= 1; dx++)
     {
-      for (int i = range.begin(); i < range.end(); i++)
-        f(i);
-    });
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        for (int dz = -1; dz <= 1; dz++)
+        {
+          if (dx > 0 || (dx == 0 && dy > 0) || (dx == 0 && dy == 0 && dz > 0))
+            offsets.emplace_back(dx, dy, dz);
+        }
+      }
+    }
+    return offsets;
+  }();
+  return offsets;
 }
 }
 
@@ -33,167 +45,297 @@ NeighborSearchSpatialHashing::~NeighborSearchSpatialHashing()
 {
 }
 
-uint32_t NeighborSearchSpatialHashing::hash3d(const glm::ivec3& p)
+glm::ivec3 NeighborSearchSpatialHashing::cellCoordinate(const glm::vec3& p) const
 {
-  glm::uvec3 up = p;
-  constexpr uint32_t p1 = 73856093;
-  constexpr uint32_t p2 = 19349663;
-  constexpr uint32_t p3 = 83492791;
-  uint32_t n = (p1 * p.x) ^ (p2 * p.y) ^ (p3 * p.z);
-  n %= hashBucketSize_;
-
-  // Allow hash collision
-  return n;
+  auto cell = glm::ivec3(glm::floor(p / h_));
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (periodicCellCount_[axis] > 0)
+      cell[axis] = static_cast<int>(std::floor((p[axis] - domain_.min()[axis]) / periodicCellSize_[axis]));
+  }
+  return wrapCell(cell);
 }
 
-void NeighborSearchSpatialHashing::computeNeighbors(const geom::Particles& particles, float h)
+glm::ivec3 NeighborSearchSpatialHashing::wrapCell(const glm::ivec3& cell) const
 {
-  if (multiprocessing_)
-    computeNeighborsMultiThreaded(particles, h);
-  else
-    computeNeighborsSingleThreaded(particles, h);
+  auto result = cell;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const auto count = periodicCellCount_[axis];
+    if (count > 0)
+      result[axis] = (cell[axis] % count + count) % count;
+  }
+  return result;
 }
 
-void NeighborSearchSpatialHashing::computeNeighborsMultiThreaded(const geom::Particles& particles, float h)
+void NeighborSearchSpatialHashing::computeNeighbors(const geom::Particles& particles, float h)
 {
-  neighbors_.clear();
-
   const auto n = particles.size();
 
-  hashTable_.resize(hashBucketSize_);
-  forEach(0, hashBucketSize_, [&](int i)
-    {
-      hashTable_[i].clear();
-    });
+  startBuild();
+  searchRadius_ = h;
+  h_ = h;
+  computePeriodicCells(h);
+  computeCells(particles);
+  computeCellIds();
+
+  // Ids stay below the table capacity, so cells entering the table keep the lists of other cells
+  cellParticles_.setMultiprocessing(multiprocessing_);
+  cellParticles_.update(particleCellIds_, table_.capacity());
+
+  occupiedCells_ = 0;
+  for (uint32_t id = 0; id < table_.size(); id++)
+  {
+    if (!cellParticles_[id].empty())
+      occupiedCells_++;
+  }
+  finishBuild();
 
+  distanceFilter_ = simd::DistanceFilter(h, domain_.extent());
   neighborsPerParticle_.resize(n);
-  forEach(0, n, [&](int i)
-    {
-      neighborsPerParticle_[i].clear();
-    });
 
-  // Add object indices to hash table, single threaded
-  for (int i = 0; i < n; i++)
+  // Cell-major neighbor search, visiting each occupied cell from its first particle
+  neighbors_.setSymmetric(symmetric_);
+  const auto visitCell = [&](int i)
   {
-    auto ipos = glm::ivec3(particles[i].position / h);
-    const auto hash = hash3d(ipos);
+    const auto id = particleCellIds_[i];
+    if (*cellParticles_[id].begin() == i)
+      findNeighborsInCell(particles, id);
+  };
 
-    hashTable_[hash].push_back(i);
-  }
+  parallel::forEach(0, n, visitCell, multiprocessing_);
+
+  // Collect neighbors
+  collectNeighbors(particles, neighborsPerParticle_);
+
+  if (statisticsEnabled_)
+    computeOccupancy();
+}
+
+void NeighborSearchSpatialHashing::queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  if (particles.size() == 0 || cells_.empty())
+    return;
 
-  // Neighbor search
-  forEach(0, n, [&](int i)
+  // Cells overlapping the query box at positions of the last build.
+  // Along periodic axes, cells wrap around, each visited once.
+  const auto r = radius + queryMargin();
+  const auto wrapped = domain_.wrap(center);
+  auto lower = glm::floor((wrapped - r) / h_);
+  auto upper = glm::floor((wrapped + r) / h_);
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const auto count = periodicCellCount_[axis];
+    if (count == 0)
+      continue;
+
+    const auto offset = (wrapped[axis] - domain_.min()[axis]) / periodicCellSize_[axis];
+    lower[axis] = std::floor(offset - r / periodicCellSize_[axis]);
+    upper[axis] = std::floor(offset + r / periodicCellSize_[axis]);
+    if (upper[axis] - lower[axis] + 1.f >= count)
     {
-      auto ipos = glm::ivec3(particles[i].position / h);
+      lower[axis] = 0.f;
+      upper[axis] = count - 1.f;
+    }
+  }
 
-      std::set<uint32_t> nearbyHashes;
-      for (int dx = -1; dx <= 1; dx++)
-      {
-        for (int dy = -1; dy <= 1; dy++)
-        {
-          for (int dz = -1; dz <= 1; dz++)
-          {
-            const auto nearbyHash = hash3d(ipos + glm::ivec3(dx, dy, dz));
-            nearbyHashes.insert(nearbyHash);
-          }
-        }
-      }
+  const auto extent = upper - lower + 1.f;
+  const auto cellCount = static_cast<double>(extent.x) * extent.y * extent.z;
+  if (!(cellCount <= particles.size()))
+  {
+    queryAllParticles(particles, center, radius, indices);
+    return;
+  }
 
-      for (auto nearbyHash : nearbyHashes)
+  const auto cellMin = glm::ivec3(lower);
+  const auto cellMax = glm::ivec3(upper);
+  for (int x = cellMin.x; x <= cellMax.x; x++)
+  {
+    for (int y = cellMin.y; y <= cellMax.y; y++)
+    {
+      for (int z = cellMin.z; z <= cellMax.z; z++)
       {
-        for (auto nearbyIndex : hashTable_[nearbyHash])
+        const auto id = table_.find(wrapCell({ x, y, z }));
+        if (id == CellTable::notFound)
+          continue;
+
+        for (auto i : cellParticles_[id])
         {
-          // Particle i and nearbyIndex
-          const auto i0 = i;
-          const auto i1 = nearbyIndex;
-          if (i0 != i1)
-          {
-            const auto& p0 = particles[i0].position;
-            const auto& p1 = particles[i1].position;
-
-            if (glm::dot(p0 - p1, p0 - p1) <= h * h)
-            {
-              neighborsPerParticle_[i].push_back(i1);
-            }
-          }
+          const auto d = domain_.displacement(center, particles.position(i));
+          if (glm::dot(d, d) <= radius * radius)
+            indices.push_back(i);
         }
       }
-    });
+    }
+  }
+}
 
-  // Collect neighbors
-  for (int i = 0; i < n; i++)
+void NeighborSearchSpatialHashing::computeOccupancy()
+{
+  for (uint32_t id = 0; id < table_.size(); id++)
   {
-    Neighbor neighbor;
-    neighbor.i0 = i;
+    const auto particles = cellParticles_[id];
+    if (!particles.empty())
+      addOccupiedCell(particles.size());
+  }
+
+  statistics_.collisionRate = table_.displacedRate();
+}
 
-    for (auto i1 : neighborsPerParticle_[i])
+void NeighborSearchSpatialHashing::computePeriodicCells(float h)
+{
+  halfStencil_ = true;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (domain_.periodic()[axis])
+    {
+      const auto length = domain_.max()[axis] - domain_.min()[axis];
+      const auto count = std::max(std::floor(length / h), 1.f);
+      periodicCellCount_[axis] = static_cast<int>(count);
+      periodicCellSize_[axis] = length / count;
+      halfStencil_ = halfStencil_ && count >= 3.f;
+    }
+    else
     {
-      neighbor.i1 = i1;
-      neighbors_.push_back(neighbor);
+      periodicCellCount_[axis] = 0;
+      periodicCellSize_[axis] = 0.f;
     }
   }
 }
 
-void NeighborSearchSpatialHashing::computeNeighborsSingleThreaded(const geom::Particles& particles, float h)
+void NeighborSearchSpatialHashing::computeCells(const geom::Particles& particles)
 {
-  neighbors_.resize(0);
-
   const auto n = particles.size();
 
-  // Clear hash table cache
-  hashTable_.resize(hashBucketSize_);
-  for (int i = 0; i < hashTable_.size(); i++)
-    hashTable_[i].clear();
+  cells_.resize(n);
+  parallel::forEach(0, n, [&](int i)
+    {
+      cells_[i] = cellCoordinate(particles.position(i));
+    }, multiprocessing_);
+}
+
+void NeighborSearchSpatialHashing::computeCellIds()
+{
+  const int n = cells_.size();
 
-  // Add object indices to hash table
-  for (int i = 0; i < n; i++)
+  // Cells emptied since the table was cleared keep their ids, until they outnumber occupied cells
+  if (table_.size() > 2 * occupiedCells_ + minTableSize_)
   {
-    auto ipos = glm::ivec3(particles[i].position / h);
-    const auto hash = hash3d(ipos);
+    table_.clear(occupiedCells_);
+    cellParticles_.invalidate();
+  }
 
-    hashTable_[hash].push_back(i);
+  particleCellIds_.resize(n);
+  parallel::forEach(0, n, [&](int i)
+    {
+      particleCellIds_[i] = table_.find(cells_[i]);
+    }, multiprocessing_);
+
+  // Particles in cells not in the table yet, whose cells are inserted in particle order
+  newCellParticles_.resize(n);
+  const auto newCount = parallel::compact(n, [&](int i) { return particleCellIds_[i] == CellTable::notFound; }, newCellParticles_.data(), multiprocessing_);
+  for (uint32_t k = 0; k < newCount; k++)
+  {
+    const auto i = newCellParticles_[k];
+    particleCellIds_[i] = table_.insert(cells_[i]);
   }
+}
+
+void NeighborSearchSpatialHashing::findNeighborsInCell(const geom::Particles& particles, uint32_t id)
+{
+  const auto cellParticles = cellParticles_[id];
+  const auto halfStencil = symmetric_ && halfStencil_;
 
-  // Neighbor search
-  for (int i = 0; i < n; i++)
+  auto& candidates = candidates_.local();
+  gatherCandidates(particles, id, candidates);
+
+  const auto count = static_cast<uint32_t>(candidates.indices.size());
+  candidates.found.resize(count + simd::DistanceFilter::padding);
+
+  // Test all particles of the home cell against the candidates
+  for (uint32_t k = 0; k < cellParticles.size(); k++)
   {
-    auto ipos = glm::ivec3(particles[i].position / h);
+    const auto i = cellParticles.begin()[k];
+
+    auto& neighbors = neighborsPerParticle_[i];
+    neighbors.clear();
+    if (!queried(particles, i))
+      continue;
+
+    // Symmetric search takes pairs with particles after this one in the home cell, which come first among candidates,
+    // or by index order when forward cells are not distinct
+    const auto first = halfStencil ? k + 1 : 0;
+    const auto foundCount = distanceFilter_(particles.position(i),
+      candidates.x.data() + first, candidates.y.data() + first, candidates.z.data() + first,
+      candidates.indices.data() + first, count - first, candidates.found.data());
+
+    for (uint32_t f = 0; f < foundCount; f++)
+    {
+      const auto i1 = candidates.found[f];
+      if (halfStencil || (symmetric_ ? i1 > i : i1 != i))
+        neighbors.push_back(i1);
+    }
+  }
+}
 
-    std::set<uint32_t> nearbyHashes;
+void NeighborSearchSpatialHashing::gatherCandidates(const geom::Particles& particles, uint32_t id, Candidates& candidates)
+{
+  candidates.clear();
+
+  const auto& cell = table_[id];
+  if (symmetric_ && halfStencil_)
+  {
+    // The home cell, then forward cells, distinct from each other and from the home cell
+    candidates.add(particles, cellParticles_[id]);
+    for (const auto& offset : forwardCellOffsets())
+    {
+      const auto nearbyId = table_.find(wrapCell(cell + offset));
+      if (nearbyId != CellTable::notFound)
+        candidates.add(particles, cellParticles_[nearbyId]);
+    }
+  }
+  else
+  {
+    // 27 nearby cells, visiting cells wrapped around short periodic axes once
+    std::array<uint32_t, 27> nearbyIds;
+    int nearbyCount = 0;
     for (int dx = -1; dx <= 1; dx++)
     {
       for (int dy = -1; dy <= 1; dy++)
       {
         for (int dz = -1; dz <= 1; dz++)
         {
-          const auto nearbyHash = hash3d(ipos + glm::ivec3(dx, dy, dz));
-          nearbyHashes.insert(nearbyHash);
+          const auto nearbyId = table_.find(wrapCell(cell + glm::ivec3(dx, dy, dz)));
+          if (nearbyId != CellTable::notFound && std::find(nearbyIds.begin(), nearbyIds.begin() + nearbyCount, nearbyId) == nearbyIds.begin() + nearbyCount)
+            nearbyIds[nearbyCount++] = nearbyId;
         }
       }
     }
 
-    for (auto nearbyHash : nearbyHashes)
-    {
-      for (auto nearbyIndex : hashTable_[nearbyHash])
-      {
-        // Particle i and nearbyIndex
-        const auto i0 = i;
-        const auto i1 = nearbyIndex;
-        if (i0 != i1)
-        {
-          const auto& p0 = particles[i0].position;
-          const auto& p1 = particles[i1].position;
-
-          if (glm::dot(p0 - p1, p0 - p1) <= h * h)
-          {
-            Neighbor neighbor;
-            neighbor.i0 = i0;
-            neighbor.i1 = i1;
-            neighbors_.push_back(neighbor);
-          }
-        }
-      }
-    }
+    for (int i = 0; i < nearbyCount; i++)
+      candidates.add(particles, cellParticles_[nearbyIds[i]]);
+  }
+}
+
+void NeighborSearchSpatialHashing::Candidates::clear()
+{
+  indices.clear();
+  x.clear();
+  y.clear();
+  z.clear();
+}
+
+void NeighborSearchSpatialHashing::Candidates::add(const geom::Particles& particles, CellList::Range cellParticles)
+{
+  const auto& px = particles.x();
+  const auto& py = particles.y();
+  const auto& pz = particles.z();
+  for (auto i : cellParticles)
+  {
+    indices.push_back(i);
+    x.push_back(px[i]);
+    y.push_back(py[i]);
+    z.push_back(pz[i]);
   }
 }
 }
@@ -0,0 +1,339 @@
+#include <splash/fluid/neighbor_search_uniform_grid.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <tbb/tbb.h>
+
+#include <splash/geom/particles.h>
+
+namespace splash
+{
+namespace fluid
+{
+namespace
+{
+bool isForward(const glm::ivec3& offset)
+{
+  return offset.x > 0 || (offset.x == 0 && offset.y > 0) || (offset.x == 0 && offset.y == 0 && offset.z > 0);
+}
+}
+
+NeighborSearchUniformGrid::NeighborSearchUniformGrid()
+  : NeighborSearch()
+{
+}
+
+NeighborSearchUniformGrid::~NeighborSearchUniformGrid()
+{
+}
+
+void NeighborSearchUniformGrid::computeNeighbors(const geom::Particles& particles, float h)
+{
+  const auto n = particles.size();
+
+  startBuild();
+  searchRadius_ = h;
+  if (n == 0)
+  {
+    neighbors_.reset(0);
+    return;
+  }
+
+  // New layout when particles leave the grid along non-periodic axes
+  computeBoundingBox(particles);
+  const auto& periodic = domain_.periodic();
+  auto inside = true;
+  for (int axis = 0; axis < 3; axis++)
+    inside = inside && (periodic[axis] || (boundsMin_[axis] >= min_[axis] && boundsMax_[axis] <= max_[axis]));
+
+  if (h != h_ || !inside || domain_ != layoutDomain_)
+  {
+    h_ = h;
+    layoutDomain_ = domain_;
+    min_ = boundsMin_ - margin_ * h;
+    max_ = boundsMax_ + margin_ * h;
+    for (int axis = 0; axis < 3; axis++)
+    {
+      if (periodic[axis])
+      {
+        min_[axis] = domain_.min()[axis];
+        max_[axis] = domain_.max()[axis];
+      }
+    }
+    computeGridDimensions(h);
+    cells_.invalidate();
+  }
+
+  computeParticleCells(particles);
+  cells_.setMultiprocessing(multiprocessing_);
+  cells_.update(particleCells_, dimensions_.x * dimensions_.y * dimensions_.z);
+  finishBuild();
+
+  const auto forEach = [&](int begin, int end, std::function<void(int)> f)
+  {
+    if (multiprocessing_)
+    {
+      tbb::parallel_for(tbb::blocked_range<int>(begin, end),
+        [&](const tbb::blocked_range<int>& range)
+        {
+          for (int i = range.begin(); i < range.end(); i++)
+            f(i);
+        });
+    }
+    else
+    {
+      for (int i = begin; i < end; i++)
+        f(i);
+    }
+  };
+
+  // The half stencil needs distinct cells at offsets -1 and 1, otherwise symmetric pairs are taken by index order
+  auto halfStencil = symmetric_;
+  for (int axis = 0; axis < 3; axis++)
+    halfStencil = halfStencil && (!periodic[axis] || dimensions_[axis] >= 3);
+
+  // Neighbor search over 27 nearby cells
+  const auto periodicDomain = domain_.enabled();
+  neighbors_.setSymmetric(symmetric_);
+  neighborsPerParticle_.resize(n);
+  forEach(0, n, [&](int i)
+    {
+      auto& neighbors = neighborsPerParticle_[i];
+      neighbors.clear();
+      if (!queried(particles, i))
+        return;
+
+      const auto p0 = particles.position(i);
+      const auto cell = cellCoordinate(p0);
+
+      std::array<glm::ivec2, 3> nearbyX, nearbyY, nearbyZ;
+      const auto countX = nearbyCoordinates(cell, 0, nearbyX);
+      const auto countY = nearbyCoordinates(cell, 1, nearbyY);
+      const auto countZ = nearbyCoordinates(cell, 2, nearbyZ);
+
+      for (int x = 0; x < countX; x++)
+      {
+        for (int y = 0; y < countY; y++)
+        {
+          for (int z = 0; z < countZ; z++)
+          {
+            // Half stencil: the home cell and 13 cells lexicographically after it
+            const glm::ivec3 offset(nearbyX[x].y, nearbyY[y].y, nearbyZ[z].y);
+            const auto home = offset == glm::ivec3(0);
+            if (halfStencil && !home && !isForward(offset))
+              continue;
+
+            for (auto i1 : cells_[cellIndex({ nearbyX[x].x, nearbyY[y].x, nearbyZ[z].x })])
+            {
+              if ((symmetric_ && (home || !halfStencil)) ? i1 > i : i1 != i)
+              {
+                const auto p1 = particles.position(i1);
+                const auto d = periodicDomain ? domain_.displacement(p0, p1) : p0 - p1;
+                if (glm::dot(d, d) <= h * h)
+                  neighbors.push_back(i1);
+              }
+            }
+          }
+        }
+      }
+    });
+
+  // Collect neighbors
+  collectNeighbors(particles, neighborsPerParticle_);
+
+  if (statisticsEnabled_)
+  {
+    for (uint32_t cell = 0; cell < cells_.cellCount(); cell++)
+    {
+      if (!cells_[cell].empty())
+        addOccupiedCell(cells_[cell].size());
+    }
+  }
+}
+
+void NeighborSearchUniformGrid::queryPoint(const geom::Particles& particles, const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  if (particles.size() == 0 || cells_.cellCount() == 0)
+    return;
+
+  // Cells overlapping the query box at positions of the last build, which are all inside the grid.
+  // Along periodic axes, cells wrap around, each visited once.
+  const auto& periodic = domain_.periodic();
+  const auto r = radius + queryMargin();
+  const auto wrapped = domain_.wrap(center);
+  const auto lower = glm::floor((wrapped - r - min_) / cellSize_);
+  const auto upper = glm::floor((wrapped + r - min_) / cellSize_);
+
+  glm::ivec3 first;
+  glm::ivec3 count;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const auto last = static_cast<float>(dimensions_[axis] - 1);
+    if (periodic[axis] && upper[axis] - lower[axis] + 1.f < dimensions_[axis])
+    {
+      first[axis] = static_cast<int>(lower[axis]);
+      count[axis] = static_cast<int>(upper[axis] - lower[axis]) + 1;
+    }
+    else if (periodic[axis])
+    {
+      first[axis] = 0;
+      count[axis] = dimensions_[axis];
+    }
+    else if (upper[axis] < 0.f || lower[axis] > last)
+      return;
+    else
+    {
+      first[axis] = static_cast<int>(std::max(lower[axis], 0.f));
+      count[axis] = static_cast<int>(std::min(upper[axis], last)) - first[axis] + 1;
+    }
+  }
+
+  const auto cellCount = static_cast<double>(count.x) * count.y * count.z;
+  if (cellCount > particles.size())
+  {
+    queryAllParticles(particles, center, radius, indices);
+    return;
+  }
+
+  const auto wrap = [&](int c, int axis)
+  {
+    return periodic[axis] ? (c % dimensions_[axis] + dimensions_[axis]) % dimensions_[axis] : c;
+  };
+
+  for (int x = 0; x < count.x; x++)
+  {
+    for (int y = 0; y < count.y; y++)
+    {
+      for (int z = 0; z < count.z; z++)
+      {
+        const glm::ivec3 cell(wrap(first.x + x, 0), wrap(first.y + y, 1), wrap(first.z + z, 2));
+        for (auto i : cells_[cellIndex(cell)])
+        {
+          const auto d = domain_.displacement(center, particles.position(i));
+          if (glm::dot(d, d) <= radius * radius)
+            indices.push_back(i);
+        }
+      }
+    }
+  }
+}
+
+void NeighborSearchUniformGrid::computeBoundingBox(const geom::Particles& particles)
+{
+  const auto n = particles.size();
+
+  boundsMin_ = particles.position(0);
+  boundsMax_ = particles.position(0);
+  for (int i = 1; i < n; i++)
+  {
+    const auto p = particles.position(i);
+    boundsMin_ = glm::min(boundsMin_, p);
+    boundsMax_ = glm::max(boundsMax_, p);
+  }
+}
+
+void NeighborSearchUniformGrid::computeGridDimensions(float h)
+{
+  // Cells as large as h, so that neighbors are found within 27 nearby cells.
+  // Cells larger than h are still correct, only with more candidates.
+  const auto& periodic = domain_.periodic();
+  auto size = h;
+  while (true)
+  {
+    // Periodic axes have a whole number of cells in the domain, at least as large as size
+    glm::vec3 extent;
+    for (int axis = 0; axis < 3; axis++)
+    {
+      const auto length = max_[axis] - min_[axis];
+      if (periodic[axis])
+      {
+        extent[axis] = std::max(std::floor(length / size), 1.f);
+        cellSize_[axis] = length / extent[axis];
+      }
+      else
+      {
+        extent[axis] = std::floor(length / size) + 1.f;
+        cellSize_[axis] = size;
+      }
+    }
+
+    const auto cellCount = static_cast<double>(extent.x) * extent.y * extent.z;
+    if (!(cellCount > maxCellCount_))
+    {
+      dimensions_ = extent;
+      break;
+    }
+
+    size *= 2.f;
+  }
+}
+
+void NeighborSearchUniformGrid::computeParticleCells(const geom::Particles& particles)
+{
+  const auto n = particles.size();
+
+  particleCells_.resize(n);
+  const auto computeCell = [&](int i)
+  {
+    particleCells_[i] = cellIndex(cellCoordinate(particles.position(i)));
+  };
+
+  if (multiprocessing_)
+  {
+    tbb::parallel_for(tbb::blocked_range<int>(0, n),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        for (int i = range.begin(); i < range.end(); i++)
+          computeCell(i);
+      });
+  }
+  else
+  {
+    for (int i = 0; i < n; i++)
+      computeCell(i);
+  }
+}
+
+int NeighborSearchUniformGrid::nearbyCoordinates(const glm::ivec3& cell, int axis, std::array<glm::ivec2, 3>& nearby) const
+{
+  const auto periodic = domain_.periodic()[axis];
+  const auto dimension = dimensions_[axis];
+
+  int count = 0;
+  for (auto offset : { 0, -1, 1 })
+  {
+    auto c = cell[axis] + offset;
+    if (periodic)
+      c = (c + dimension) % dimension;
+    else if (c < 0 || c >= dimension)
+      continue;
+
+    if (std::none_of(nearby.begin(), nearby.begin() + count, [c](const glm::ivec2& v) { return v.x == c; }))
+      nearby[count++] = { c, offset };
+  }
+  return count;
+}
+
+glm::ivec3 NeighborSearchUniformGrid::cellCoordinate(const glm::vec3& p) const
+{
+  const glm::ivec3 cell = glm::floor((p - min_) / cellSize_);
+
+  glm::ivec3 result;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (domain_.periodic()[axis])
+      result[axis] = (cell[axis] % dimensions_[axis] + dimensions_[axis]) % dimensions_[axis];
+    else
+      result[axis] = glm::clamp(cell[axis], 0, dimensions_[axis] - 1);
+  }
+  return result;
+}
+
+uint32_t NeighborSearchUniformGrid::cellIndex(const glm::ivec3& cell) const
+{
+  return (cell.x * dimensions_.y + cell.y) * dimensions_.z + cell.z;
+}
+}
+}
@@ -0,0 +1,789 @@
+#include <splash/fluid/pbf_solver.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <tuple>
+
+#define NOMINMAX
+#include <tbb/tbb.h>
+
+#include <splash/geom/particles.h>
+#include <splash/geom/morton.h>
+#include <splash/fluid/neighbor_search.h>
+#include <splash/fluid/sph_kernel.h>
+#include <splash/parallel/primitives.h>
+
+namespace splash
+{
+namespace fluid
+{
+namespace
+{
+// Calls f with the kernel as its concrete type, so that kernel calls in f are not virtual.
+// Other kernels are passed as SphKernel.
+template <typename F>
+void withKernelType(const SphKernel& kernel, F f)
+{
+  if (const auto* poly6 = dynamic_cast<const SphKernelPoly6*>(&kernel))
+    f(*poly6);
+  else if (const auto* spiky = dynamic_cast<const SphKernelSpiky*>(&kernel))
+    f(*spiky);
+  else
+    f(kernel);
+}
+}
+
+struct PbfSolver::KernelBatches
+{
+  tbb::enumerable_thread_specific<KernelBatch> batches;
+
+  KernelBatch& local() { return batches.local(); }
+};
+
+// Buffers of each thread for forEachScatter, kept zeroed between calls
+template <typename T>
+struct ScatterBuffer
+{
+  std::vector<T> values;
+  bool used = false; // In the current call
+};
+
+struct PbfSolver::ScatterBuffers
+{
+  std::tuple<
+    tbb::enumerable_thread_specific<ScatterBuffer<float>>,
+    tbb::enumerable_thread_specific<ScatterBuffer<glm::vec3>>,
+    tbb::enumerable_thread_specific<ScatterBuffer<glm::vec4>>> buffers;
+
+  template <typename T>
+  auto& get() { return std::get<tbb::enumerable_thread_specific<ScatterBuffer<T>>>(buffers); }
+};
+
+PbfSolver::PbfSolver()
+{
+  radixSort_ = std::make_unique<parallel::RadixSort<uint64_t, uint32_t>>();
+  kernelBatches_ = std::make_unique<KernelBatches>();
+  scatterBuffers_ = std::make_unique<ScatterBuffers>();
+}
+
+PbfSolver::~PbfSolver() = default;
+
+template <typename F>
+void PbfSolver::forEach(int begin, int end, F f)
+{
+  parallel::forEach(begin, end, f, multiprocessing_);
+}
+
+template <typename T, typename F>
+void PbfSolver::forEachScatter(int begin, int end, std::vector<T>& result, const T& zero, F f)
+{
+  if (multiprocessing_)
+  {
+    // Scatter to thread-local buffers, then sum them up to the result.
+    // Buffers persist across calls, grow only with the result, and are zeroed again as they are summed up.
+    auto& buffers = scatterBuffers_->get<T>();
+    const auto size = result.size();
+
+    tbb::parallel_for(tbb::blocked_range<int>(begin, end),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        auto& buffer = buffers.local();
+        if (!buffer.used)
+        {
+          buffer.used = true;
+          if (buffer.values.size() < size)
+            buffer.values.resize(size, zero);
+        }
+
+        for (int i = range.begin(); i < range.end(); i++)
+          f(i, buffer.values.data());
+      });
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, size),
+      [&](const tbb::blocked_range<int>& range)
+      {
+        for (auto& buffer : buffers)
+        {
+          if (!buffer.used)
+            continue;
+
+          for (int i = range.begin(); i < range.end(); i++)
+          {
+            result[i] += buffer.values[i];
+            buffer.values[i] = zero;
+          }
+        }
+      });
+
+    for (auto& buffer : buffers)
+      buffer.used = false;
+  }
+  else
+  {
+    for (int i = begin; i < end; i++)
+      f(i, result.data());
+  }
+}
+
+PbfSolver::KernelBatch& PbfSolver::gatherDisplacements(const geom::Particles& particles, int i0, NeighborList::Range neighbors)
+{
+  auto& batch = kernelBatches_->local();
+  batch.count = neighbors.size();
+  batch.radiusSquared = parameters_.h * parameters_.h;
+  if (batch.x.size() < batch.count)
+  {
+    batch.x.resize(batch.count);
+    batch.y.resize(batch.count);
+    batch.z.resize(batch.count);
+    batch.w.resize(batch.count);
+    batch.gx.resize(batch.count);
+    batch.gy.resize(batch.count);
+    batch.gz.resize(batch.count);
+  }
+
+  const auto p0 = particles.position(i0);
+  uint32_t k = 0;
+  for (auto i1 : neighbors)
+  {
+    const auto d = domain_.displacement(p0, particles.position(i1));
+    batch.x[k] = d.x;
+    batch.y[k] = d.y;
+    batch.z[k] = d.z;
+    k++;
+  }
+  return batch;
+}
+
+template <typename Kernel>
+void PbfSolver::KernelBatch::evaluate(const Kernel& kernel)
+{
+  kernel.evaluate(x.data(), y.data(), z.data(), count, w.data());
+
+  if (kernel.supportRadius() * kernel.supportRadius() > radiusSquared)
+  {
+    for (uint32_t k = 0; k < count; k++)
+    {
+      if (!withinSupport(k))
+        w[k] = 0.f;
+    }
+  }
+}
+
+template <typename Kernel>
+void PbfSolver::KernelBatch::evaluateGrad(const Kernel& kernel)
+{
+  kernel.evaluateGrad(x.data(), y.data(), z.data(), count, gx.data(), gy.data(), gz.data());
+
+  if (kernel.supportRadius() * kernel.supportRadius() > radiusSquared)
+  {
+    for (uint32_t k = 0; k < count; k++)
+    {
+      if (!withinSupport(k))
+        gx[k] = gy[k] = gz[k] = 0.f;
+    }
+  }
+}
+
+void PbfSolver::setKernels(const SphKernel* kernel, const SphKernel* gradKernel)
+{
+  kernel_ = kernel;
+  gradKernel_ = gradKernel;
+}
+
+void PbfSolver::setNeighborSearch(NeighborSearch* neighborSearch)
+{
+  if (neighborSearch != neighborSearch_ && neighborSearch != nullptr)
+    neighborSearch->invalidate();
+  neighborSearch_ = neighborSearch;
+}
+
+void PbfSolver::step(geom::Particles& particles, float dt)
+{
+  const auto n = particles.size();
+  const auto h = parameters_.h;
+
+  // Without pairs across the periodic faces, fluid would leave the domain through them
+  if (parameters_.periodicDomain.enabled() && !neighborSearch_->supportsPeriodicDomain())
+    throw std::invalid_argument("Neighbor search does not support periodic domains");
+
+  // Particle reordering, before any per-particle state of this step is computed
+  if (parameters_.reorderInterval > 0 && ++reorderStep_ >= parameters_.reorderInterval)
+  {
+    reorderStep_ = 0;
+    reorderParticles(particles);
+  }
+
+  positions_.resize(n);
+  for (int i = 0; i < n; i++)
+  {
+    // Store old particle positions
+    positions_[i] = particles.position(i);
+
+    // Update particles
+    if (particles.type(i) == geom::ParticleType::FLUID)
+    {
+      particles.velocity(i) += parameters_.gravity * dt;
+      particles.setPosition(i, particles.position(i) + particles.velocity(i) * dt);
+    }
+  }
+
+  // Neighbor search
+  auto& neighborSearch = *neighborSearch_;
+  neighborSearch.setMultiprocessing(multiprocessing_);
+  neighborSearch.setSymmetric(parameters_.symmetricNeighbors);
+  neighborSearch.setSkin(parameters_.neighborSkin * h);
+
+  // Displacements between particles are minimum images in the periodic domain
+  domain_ = parameters_.periodicDomain;
+  neighborSearch.setPeriodicDomain(domain_);
+
+  // Boundary volumes only change with boundary positions and kernel, and need boundary-boundary pairs
+  const auto boundaryChanged = !boundaryVolumesValid_ || kernel_ != boundaryKernel_;
+  neighborSearch.setBoundaryNeighbors(boundaryChanged);
+  if (neighborSearch.updateNeighbors(particles, h))
+    neighborRebuildCount_++;
+  neighborUpdateCount_++;
+
+  splitParticles(particles);
+
+  const auto n0 = fluidIndices_.size();
+  density_.resize(n0);
+  incompressibilityLambdas_.resize(n0);
+  deltaP_.resize(n0);
+
+  // Kernel types are resolved once per step, into passes specialized for them
+  if (boundaryChanged)
+  {
+    withKernelType(*kernel_, [&](const auto& kernel)
+      {
+        updateBoundaryVolumes(particles, kernel);
+      });
+    boundaryVolumesValid_ = true;
+    boundaryKernel_ = kernel_;
+  }
+
+  withKernelType(*kernel_, [&](const auto& kernel)
+    {
+      withKernelType(*gradKernel_, [&](const auto& gradKernel)
+        {
+          solve(particles, dt, kernel, gradKernel);
+        });
+    });
+}
+
+template <typename Kernel, typename GradKernel>
+void PbfSolver::solve(geom::Particles& particles, float dt, const Kernel& kernel, const GradKernel& gradKernel)
+{
+  const auto n0 = fluidIndices_.size();
+
+  // Projection steps
+  for (int iteration = 0; iteration < parameters_.iterations; iteration++)
+  {
+    computeDensities(particles, kernel);
+    computeLambdas(particles, gradKernel);
+    computeDeltaP(particles, gradKernel);
+
+    // Update positions
+    forEach(0, n0, [&](int i)
+      {
+        const auto i0 = fluidIndices_[i];
+        particles.setPosition(i0, particles.position(i0) + deltaP_[i]);
+      });
+  }
+
+  // Update velocity
+  forEach(0, n0, [&](int i)
+    {
+      const auto i0 = fluidIndices_[i];
+      particles.velocity(i0) = (particles.position(i0) - positions_[i0]) / dt;
+    });
+
+  solveViscosity(particles, kernel);
+
+  // Wrap positions into the periodic domain, after velocities are taken from the unwrapped displacements
+  if (domain_.enabled())
+  {
+    forEach(0, n0, [&](int i)
+      {
+        const auto i0 = fluidIndices_[i];
+        particles.setPosition(i0, domain_.wrap(particles.position(i0)));
+      });
+  }
+}
+
+float PbfSolver::maxSpeed(const geom::Particles& particles) const
+{
+  const auto n = particles.size();
+
+  const auto speed2 = [&](int i)
+  {
+    if (particles.type(i) != geom::ParticleType::FLUID)
+      return 0.f;
+    const auto& v = particles.velocity(i);
+    return glm::dot(v, v);
+  };
+
+  float maxSpeed2 = 0.f;
+  if (multiprocessing_)
+  {
+    maxSpeed2 = tbb::parallel_reduce(tbb::blocked_range<int>(0, n), 0.f,
+      [&](const tbb::blocked_range<int>& range, float value)
+      {
+        for (int i = range.begin(); i < range.end(); i++)
+          value = std::max(value, speed2(i));
+        return value;
+      },
+      [](float a, float b) { return std::max(a, b); });
+  }
+  else
+  {
+    for (int i = 0; i < n; i++)
+      maxSpeed2 = std::max(maxSpeed2, speed2(i));
+  }
+
+  return std::sqrt(maxSpeed2);
+}
+
+void PbfSolver::reorderParticles(geom::Particles& particles)
+{
+  const auto n = particles.size();
+  if (n == 0)
+    return;
+
+  const auto h = parameters_.h;
+  glm::vec3 min = particles.position(0);
+  for (int i = 1; i < n; i++)
+    min = glm::min(min, particles.position(i));
+
+  // Morton codes of grid cells of size h, stably sorted so that particle index breaks ties
+  constexpr uint32_t maxCoordinate = (1 << geom::mortonBits) - 1;
+  mortonCodes_.resize(n);
+  reorderIndices_.resize(n);
+  forEach(0, n, [&](int i)
+    {
+      const auto cell = glm::min((particles.position(i) - min) / h, glm::vec3(static_cast<float>(maxCoordinate)));
+      mortonCodes_[i] = geom::morton(glm::uvec3(cell));
+      reorderIndices_[i] = i;
+    });
+
+  radixSort_->setMultiprocessing(multiprocessing_);
+  radixSort_->sort(mortonCodes_, reorderIndices_, 3 * geom::mortonBits);
+
+  particles.reorder(reorderIndices_);
+
+  // Neighbor lists refer to slots, which are now of different particles
+  if (neighborSearch_ != nullptr)
+    neighborSearch_->invalidate();
+}
+
+void PbfSolver::splitParticles(const geom::Particles& particles)
+{
+  // Split fluid and boundary, by prefix sum of fluid particles
+  const auto n = particles.size();
+  fluidIndices_.resize(n);
+  boundaryIndices_.resize(n);
+  toFluidIndex_.resize(n);
+  const auto isFluid = [&](int i) { return particles.type(i) == geom::ParticleType::FLUID; };
+  const auto fluidCount = parallel::exclusiveScan<int>(n,
+    [&](int i) { return isFluid(i) ? 1 : 0; },
+    [&](int i, int fluidIndex)
+    {
+      if (isFluid(i))
+      {
+        toFluidIndex_[i] = fluidIndex;
+        fluidIndices_[fluidIndex] = i;
+      }
+      else
+      {
+        toFluidIndex_[i] = -1;
+        boundaryIndices_[i - fluidIndex] = i;
+      }
+    },
+    multiprocessing_);
+  fluidIndices_.resize(fluidCount);
+  boundaryIndices_.resize(n - fluidCount);
+}
+
+template <typename Kernel>
+void PbfSolver::updateBoundaryVolumes(geom::Particles& particles, const Kernel& kernel)
+{
+  const auto& neighbors = neighborSearch_->neighbors();
+  const auto rho0 = parameters_.restDensity;
+  const auto n = particles.size();
+  const auto n1 = boundaryIndices_.size();
+
+  // With symmetric neighbors each pair is visited once, from either of its particles,
+  // and the contribution is scattered to both.
+  const auto symmetric = neighbors.symmetric();
+
+  // Compute boundary psi
+  if (symmetric)
+  {
+    boundaryDelta_.assign(n, kernel(glm::vec3(0.f)));
+    forEachScatter<float>(0, n1, boundaryDelta_, 0.f, [&](int i, float* delta)
+      {
+        const auto i0 = boundaryIndices_[i];
+
+        auto& batch = gatherDisplacements(particles, i0, neighbors.boundary(i0));
+        batch.evaluate(kernel);
+
+        uint32_t k = 0;
+        for (auto i1 : neighbors.boundary(i0))
+        {
+          const auto w = batch.w[k++];
+          delta[i0] += w;
+          delta[i1] += w;
+        }
+      });
+  }
+
+  forEach(0, n1, [&](int i)
+    {
+      const auto i0 = boundaryIndices_[i];
+
+      float delta = kernel(glm::vec3(0.f));
+
+      if (symmetric)
+        delta = boundaryDelta_[i0];
+      else
+      {
+        auto& batch = gatherDisplacements(particles, i0, neighbors.boundary(i0));
+        batch.evaluate(kernel);
+
+        for (uint32_t k = 0; k < batch.count; k++)
+          delta += batch.w[k];
+      }
+
+      const auto volume = 1.f / delta;
+
+      // Update boundary particle mass
+      particles.mass(i0) = rho0 * volume;
+    });
+}
+
+template <typename Kernel>
+void PbfSolver::computeDensities(const geom::Particles& particles, const Kernel& kernel)
+{
+  const auto& neighbors = neighborSearch_->neighbors();
+  const auto n = particles.size();
+  const auto n0 = fluidIndices_.size();
+
+  if (neighbors.symmetric())
+  {
+    // Contribution from self
+    forEach(0, n0, [&](int i)
+      {
+        const auto i0 = fluidIndices_[i];
+        density_[i] = particles.mass(i0) * kernel(glm::vec3(0.f));
+      });
+
+    // Contribution from neighbors, to both particles of each pair. Boundary particles receive none.
+    forEachScatter<float>(0, n, density_, 0.f, [&](int i0, float* density)
+      {
+        const auto f0 = toFluidIndex_[i0];
+        const auto m0 = particles.mass(i0);
+
+        auto& batch = gatherDisplacements(particles, i0, neighbors.fluid(i0));
+        batch.evaluate(kernel);
+
+        uint32_t k = 0;
+        if (f0 >= 0)
+        {
+          for (auto i1 : neighbors.fluid(i0))
+          {
+            const auto w = batch.w[k++];
+            density[f0] += particles.mass(i1) * w;
+            density[toFluidIndex_[i1]] += m0 * w;
+          }
+
+          gatherDisplacements(particles, i0, neighbors.boundary(i0)).evaluate(kernel);
+
+          k = 0;
+          for (auto i1 : neighbors.boundary(i0))
+            density[f0] += particles.mass(i1) * batch.w[k++];
+        }
+        else
+        {
+          for (auto i1 : neighbors.fluid(i0))
+            density[toFluidIndex_[i1]] += m0 * batch.w[k++];
+        }
+      });
+  }
+  else
+  {
+    forEach(0, n0, [&](int i)
+      {
+        const auto i0 = fluidIndices_[i];
+
+        // Contribution from self
+        density_[i] = particles.mass(i0) * kernel(glm::vec3(0.f));
+
+        // Contribution from neighbors
+        auto& batch = gatherDisplacements(particles, i0, neighbors[i0]);
+        batch.evaluate(kernel);
+
+        uint32_t k = 0;
+        for (auto i1 : neighbors[i0])
+          density_[i] += particles.mass(i1) * batch.w[k++];
+      });
+  }
+}
+
+template <typename GradKernel>
+void PbfSolver::computeLambdas(const geom::Particles& particles, const GradKernel& gradKernel)
+{
+  const auto& neighbors = neighborSearch_->neighbors();
+  const auto rho0 = parameters_.restDensity;
+  const auto n = particles.size();
+  const auto n0 = fluidIndices_.size();
+  const auto symmetric = neighbors.symmetric();
+
+  // Self gradient (xyz) and denominator (w) of lambdas, for symmetric neighbors
+  if (symmetric)
+  {
+    lambdaGradients_.assign(n0, glm::vec4(0.f));
+    forEachScatter<glm::vec4>(0, n, lambdaGradients_, glm::vec4(0.f), [&](int i0, glm::vec4* gradients)
+      {
+        const auto f0 = toFluidIndex_[i0];
+        const auto m0 = particles.mass(i0);
+
+        auto& batch = gatherDisplacements(particles, i0, neighbors.fluid(i0));
+        batch.evaluateGrad(gradKernel);
+
+        // Gradients from i1 to i0, which are the opposite of from i0 to i1.
+        // Denominators only have movable fluid particles.
+        uint32_t k = 0;
+        if (f0 >= 0)
+        {
+          for (auto i1 : neighbors.fluid(i0))
+          {
+            const auto f1 = toFluidIndex_[i1];
+            const auto m1 = particles.mass(i1);
+
+            const auto grad = batch.grad(k++);
+            const auto grad2 = glm::dot(grad, grad);
+
+            gradients[f0] += glm::vec4(1.f / rho0 * m1 * grad, m1 * m1 / (rho0 * rho0) * grad2);
+            gradients[f1] += glm::vec4(-1.f / rho0 * m0 * grad, m0 * m0 / (rho0 * rho0) * grad2);
+          }
+
+          gatherDisplacements(particles, i0, neighbors.boundary(i0)).evaluateGrad(gradKernel);
+
+          k = 0;
+          for (auto i1 : neighbors.boundary(i0))
+          {
+            const auto m1 = particles.mass(i1);
+            gradients[f0] += glm::vec4(1.f / rho0 * m1 * batch.grad(k++), 0.f);
+          }
+        }
+        else
+        {
+          for (auto i1 : neighbors.fluid(i0))
+          {
+            const auto f1 = toFluidIndex_[i1];
+            gradients[f1] += glm::vec4(-1.f / rho0 * m0 * batch.grad(k++), 0.f);
+          }
+        }
+      });
+  }
+
+  // Solve project to make incompressibility = 0
+  forEach(0, n0, [&](int i)
+    {
+      const auto i0 = fluidIndices_[i];
+
+      const auto incompressibility = std::max(density_[i] / rho0 - 1.f, 0.f);
+      if (incompressibility > 0.f && symmetric)
+      {
+        const auto selfGrad = glm::vec3(lambdaGradients_[i]);
+        const auto denom = lambdaGradients_[i].w + glm::dot(selfGrad, selfGrad);
+
+        // Compute lambdas
+        incompressibilityLambdas_[i] = -incompressibility / denom;
+      }
+      else if (incompressibility > 0.f)
+      {
+        glm::vec3 selfGrad(0.f);
+        float denom = 0.f;
+
+        auto& batch = gatherDisplacements(particles, i0, neighbors.fluid(i0));
+        batch.evaluateGrad(gradKernel);
+
+        uint32_t k = 0;
+        for (auto i1 : neighbors.fluid(i0))
+        {
+          const auto m1 = particles.mass(i1);
+          const auto grad = batch.grad(k++);
+
+          const glm::vec3 grad0 = 1.f / rho0 * m1 * grad;
+          const glm::vec3 grad1 = -1.f / rho0 * m1 * grad;
+
+          // Add to gradient by self, and to denominator for movable fluid particles
+          selfGrad += grad0;
+          denom += glm::dot(grad1, grad1);
+        }
+
+        gatherDisplacements(particles, i0, neighbors.boundary(i0)).evaluateGrad(gradKernel);
+
+        k = 0;
+        for (auto i1 : neighbors.boundary(i0))
+        {
+          const auto m1 = particles.mass(i1);
+
+          // Add to gradient by self
+          selfGrad += 1.f / rho0 * m1 * batch.grad(k++);
+        }
+
+        denom += glm::dot(selfGrad, selfGrad);
+
+        // Compute lambdas
+        incompressibilityLambdas_[i] = -incompressibility / denom;
+      }
+      else
+        incompressibilityLambdas_[i] = 0.f;
+    });
+}
+
+template <typename GradKernel>
+void PbfSolver::computeDeltaP(const geom::Particles& particles, const GradKernel& gradKernel)
+{
+  const auto& neighbors = neighborSearch_->neighbors();
+  const auto rho0 = parameters_.restDensity;
+  const auto n = particles.size();
+  const auto n0 = fluidIndices_.size();
+
+  for (int i = 0; i < n0; i++)
+    deltaP_[i] = glm::vec3(0.f);
+
+  if (neighbors.symmetric())
+  {
+    forEachScatter<glm::vec3>(0, n, deltaP_, glm::vec3(0.f), [&](int i0, glm::vec3* deltaP)
+      {
+        const auto f0 = toFluidIndex_[i0];
+        const auto m0 = particles.mass(i0);
+
+        auto& batch = gatherDisplacements(particles, i0, neighbors.fluid(i0));
+        batch.evaluateGrad(gradKernel);
+
+        // Lambdas of boundary particles are zero
+        uint32_t k = 0;
+        if (f0 >= 0)
+        {
+          const auto lambda0 = incompressibilityLambdas_[f0];
+
+          for (auto i1 : neighbors.fluid(i0))
+          {
+            const auto f1 = toFluidIndex_[i1];
+            const auto grad = 1.f / rho0 * (lambda0 + incompressibilityLambdas_[f1]) * batch.grad(k++);
+            deltaP[f0] += particles.mass(i1) * grad;
+            deltaP[f1] -= m0 * grad;
+          }
+
+          gatherDisplacements(particles, i0, neighbors.boundary(i0)).evaluateGrad(gradKernel);
+
+          k = 0;
+          for (auto i1 : neighbors.boundary(i0))
+            deltaP[f0] += particles.mass(i1) * (1.f / rho0 * lambda0 * batch.grad(k++));
+        }
+        else
+        {
+          for (auto i1 : neighbors.fluid(i0))
+          {
+            const auto f1 = toFluidIndex_[i1];
+            deltaP[f1] -= m0 * (1.f / rho0 * incompressibilityLambdas_[f1] * batch.grad(k++));
+          }
+        }
+      });
+  }
+  else
+  {
+    forEach(0, n0, [&](int i)
+      {
+        const auto i0 = fluidIndices_[i];
+
+        auto& batch = gatherDisplacements(particles, i0, neighbors.fluid(i0));
+        batch.evaluateGrad(gradKernel);
+
+        uint32_t k = 0;
+        for (auto i1 : neighbors.fluid(i0))
+        {
+          const auto m1 = particles.mass(i1);
+          deltaP_[i] += 1.f / rho0 * (incompressibilityLambdas_[i] + incompressibilityLambdas_[toFluidIndex_[i1]]) * m1 * batch.grad(k++);
+        }
+
+        gatherDisplacements(particles, i0, neighbors.boundary(i0)).evaluateGrad(gradKernel);
+
+        k = 0;
+        for (auto i1 : neighbors.boundary(i0))
+        {
+          const auto m1 = particles.mass(i1);
+          deltaP_[i] += 1.f / rho0 * incompressibilityLambdas_[i] * m1 * batch.grad(k++);
+        }
+      });
+  }
+}
+
+template <typename Kernel>
+void PbfSolver::solveViscosity(geom::Particles& particles, const Kernel& kernel)
+{
+  const auto& neighbors = neighborSearch_->neighbors();
+  const auto viscosity = parameters_.viscosity;
+  const auto n = particles.size();
+  const auto n0 = fluidIndices_.size();
+
+  if (neighbors.symmetric())
+  {
+    deltaV_.assign(n0, glm::vec3(0.f));
+    forEachScatter<glm::vec3>(0, n, deltaV_, glm::vec3(0.f), [&](int i0, glm::vec3* deltaV)
+      {
+        const auto f0 = toFluidIndex_[i0];
+        if (f0 < 0)
+          return;
+
+        auto& batch = gatherDisplacements(particles, i0, neighbors.fluid(i0));
+        batch.evaluate(kernel);
+
+        uint32_t k = 0;
+        for (auto i1 : neighbors.fluid(i0))
+        {
+          const auto f1 = toFluidIndex_[i1];
+          const auto dv = viscosity * (particles.velocity(i0) - particles.velocity(i1)) * batch.w[k++];
+          deltaV[f0] -= (particles.mass(i1) / density_[f1]) * dv;
+          deltaV[f1] += (particles.mass(i0) / density_[f0]) * dv;
+        }
+      });
+
+    forEach(0, n0, [&](int i)
+      {
+        const auto i0 = fluidIndices_[i];
+        particles.velocity(i0) += deltaV_[i];
+      });
+  }
+  else
+  {
+    // Serial, as velocities of neighbors are read while they are updated
+    for (int i = 0; i < n0; i++)
+    {
+      const auto i0 = fluidIndices_[i];
+
+      auto& batch = gatherDisplacements(particles, i0, neighbors.fluid(i0));
+      batch.evaluate(kernel);
+
+      uint32_t k = 0;
+      for (auto i1 : neighbors.fluid(i0))
+      {
+        const auto& v0 = particles.velocity(i0);
+        const auto& v1 = particles.velocity(i1);
+
+        const auto m1 = particles.mass(i1);
+
+        const auto density1 = density_[toFluidIndex_[i1]];
+
+        particles.velocity(i0) -= viscosity * (m1 / density1) * (v0 - v1) * batch.w[k++];
+      }
+    }
+  }
+}
+}
+}
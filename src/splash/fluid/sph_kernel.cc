@@ -0,0 +1,333 @@
+#include <splash/fluid/sph_kernel.h>
+
+#include <cmath>
+
+#include <splash/simd/target.h>
+
+namespace splash
+{
+namespace fluid
+{
+namespace
+{
+constexpr float pi = 3.1415926535897932384626433832795f;
+
+// Vectorized kernels take constants of the scalar kernels, and evaluate the same operations in the same order,
+// with lanes beyond the support radius zeroed by mask. Each returns how many displacements it evaluated,
+// a multiple of its lane count, and leaves the rest to the caller.
+#ifdef SPLASH_SIMD_X86
+SPLASH_SIMD_TARGET("avx2")
+inline __m256 squaredLength(__m256 x, __m256 y, __m256 z)
+{
+  return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+}
+
+SPLASH_SIMD_TARGET("avx512f")
+inline __m512 squaredLength(__m512 x, __m512 y, __m512 z)
+{
+  return _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y)), _mm512_mul_ps(z, z));
+}
+
+SPLASH_SIMD_TARGET("avx2")
+uint32_t poly6ValuesAvx2(float h2, float h3, const float* x, const float* y, const float* z, uint32_t count, float* w)
+{
+  const auto vh2 = _mm256_set1_ps(h2);
+  const auto vh3 = _mm256_set1_ps(h3);
+  const auto scale = _mm256_set1_ps(315.f / 64.f / pi);
+
+  uint32_t k = 0;
+  for (; k + 8 <= count; k += 8)
+  {
+    const auto r2 = squaredLength(_mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k), _mm256_loadu_ps(z + k));
+    const auto inside = _mm256_cmp_ps(r2, vh2, _CMP_LE_OQ);
+
+    const auto f = _mm256_div_ps(_mm256_sub_ps(vh2, r2), vh3);
+    const auto f3 = _mm256_mul_ps(_mm256_mul_ps(f, f), f);
+    _mm256_storeu_ps(w + k, _mm256_and_ps(_mm256_mul_ps(scale, f3), inside));
+  }
+  return k;
+}
+
+SPLASH_SIMD_TARGET("avx512f")
+uint32_t poly6ValuesAvx512(float h2, float h3, const float* x, const float* y, const float* z, uint32_t count, float* w)
+{
+  const auto vh2 = _mm512_set1_ps(h2);
+  const auto vh3 = _mm512_set1_ps(h3);
+  const auto scale = _mm512_set1_ps(315.f / 64.f / pi);
+
+  uint32_t k = 0;
+  for (; k + 16 <= count; k += 16)
+  {
+    const auto r2 = squaredLength(_mm512_loadu_ps(x + k), _mm512_loadu_ps(y + k), _mm512_loadu_ps(z + k));
+    const auto inside = _mm512_cmp_ps_mask(r2, vh2, _CMP_LE_OQ);
+
+    const auto f = _mm512_div_ps(_mm512_sub_ps(vh2, r2), vh3);
+    const auto f3 = _mm512_mul_ps(_mm512_mul_ps(f, f), f);
+    _mm512_storeu_ps(w + k, _mm512_maskz_mov_ps(inside, _mm512_mul_ps(scale, f3)));
+  }
+
+  // Remaining displacements 8 at a time
+  return k + poly6ValuesAvx2(h2, h3, x + k, y + k, z + k, count - k, w + k);
+}
+
+SPLASH_SIMD_TARGET("avx2")
+uint32_t poly6GradientsAvx2(float h, float h2, float h4, const float* x, const float* y, const float* z, uint32_t count, float* gx, float* gy, float* gz)
+{
+  const auto vh = _mm256_set1_ps(h);
+  const auto vh2 = _mm256_set1_ps(h2);
+  const auto vh4 = _mm256_set1_ps(h4);
+  const auto scale = _mm256_set1_ps(-945.f / 32.f / pi);
+
+  uint32_t k = 0;
+  for (; k + 8 <= count; k += 8)
+  {
+    const auto dx = _mm256_loadu_ps(x + k);
+    const auto dy = _mm256_loadu_ps(y + k);
+    const auto dz = _mm256_loadu_ps(z + k);
+    const auto r2 = squaredLength(dx, dy, dz);
+    const auto inside = _mm256_cmp_ps(r2, vh2, _CMP_LE_OQ);
+
+    const auto f = _mm256_div_ps(_mm256_sub_ps(vh2, r2), vh4);
+    const auto s = _mm256_mul_ps(scale, _mm256_mul_ps(f, f));
+    _mm256_storeu_ps(gx + k, _mm256_and_ps(_mm256_mul_ps(s, _mm256_div_ps(dx, vh)), inside));
+    _mm256_storeu_ps(gy + k, _mm256_and_ps(_mm256_mul_ps(s, _mm256_div_ps(dy, vh)), inside));
+    _mm256_storeu_ps(gz + k, _mm256_and_ps(_mm256_mul_ps(s, _mm256_div_ps(dz, vh)), inside));
+  }
+  return k;
+}
+
+SPLASH_SIMD_TARGET("avx512f")
+uint32_t poly6GradientsAvx512(float h, float h2, float h4, const float* x, const float* y, const float* z, uint32_t count, float* gx, float* gy, float* gz)
+{
+  const auto vh = _mm512_set1_ps(h);
+  const auto vh2 = _mm512_set1_ps(h2);
+  const auto vh4 = _mm512_set1_ps(h4);
+  const auto scale = _mm512_set1_ps(-945.f / 32.f / pi);
+
+  uint32_t k = 0;
+  for (; k + 16 <= count; k += 16)
+  {
+    const auto dx = _mm512_loadu_ps(x + k);
+    const auto dy = _mm512_loadu_ps(y + k);
+    const auto dz = _mm512_loadu_ps(z + k);
+    const auto r2 = squaredLength(dx, dy, dz);
+    const auto inside = _mm512_cmp_ps_mask(r2, vh2, _CMP_LE_OQ);
+
+    const auto f = _mm512_div_ps(_mm512_sub_ps(vh2, r2), vh4);
+    const auto s = _mm512_mul_ps(scale, _mm512_mul_ps(f, f));
+    _mm512_storeu_ps(gx + k, _mm512_maskz_mov_ps(inside, _mm512_mul_ps(s, _mm512_div_ps(dx, vh))));
+    _mm512_storeu_ps(gy + k, _mm512_maskz_mov_ps(inside, _mm512_mul_ps(s, _mm512_div_ps(dy, vh))));
+    _mm512_storeu_ps(gz + k, _mm512_maskz_mov_ps(inside, _mm512_mul_ps(s, _mm512_div_ps(dz, vh))));
+  }
+
+  return k + poly6GradientsAvx2(h, h2, h4, x + k, y + k, z + k, count - k, gx + k, gy + k, gz + k);
+}
+
+SPLASH_SIMD_TARGET("avx2")
+uint32_t spikyValuesAvx2(float h, float h2, const float* x, const float* y, const float* z, uint32_t count, float* w)
+{
+  const auto vh = _mm256_set1_ps(h);
+  const auto vh2 = _mm256_set1_ps(h2);
+  const auto scale = _mm256_set1_ps(15.f / pi);
+
+  uint32_t k = 0;
+  for (; k + 8 <= count; k += 8)
+  {
+    const auto r2 = squaredLength(_mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k), _mm256_loadu_ps(z + k));
+    const auto inside = _mm256_cmp_ps(r2, vh2, _CMP_LE_OQ);
+
+    const auto r1 = _mm256_sqrt_ps(r2);
+    const auto f = _mm256_div_ps(_mm256_sub_ps(vh, r1), vh2);
+    const auto f3 = _mm256_mul_ps(_mm256_mul_ps(f, f), f);
+    _mm256_storeu_ps(w + k, _mm256_and_ps(_mm256_mul_ps(scale, f3), inside));
+  }
+  return k;
+}
+
+SPLASH_SIMD_TARGET("avx512f")
+uint32_t spikyValuesAvx512(float h, float h2, const float* x, const float* y, const float* z, uint32_t count, float* w)
+{
+  const auto vh = _mm512_set1_ps(h);
+  const auto vh2 = _mm512_set1_ps(h2);
+  const auto scale = _mm512_set1_ps(15.f / pi);
+
+  uint32_t k = 0;
+  for (; k + 16 <= count; k += 16)
+  {
+    const auto r2 = squaredLength(_mm512_loadu_ps(x + k), _mm512_loadu_ps(y + k), _mm512_loadu_ps(z + k));
+    const auto inside = _mm512_cmp_ps_mask(r2, vh2, _CMP_LE_OQ);
+
+    const auto r1 = _mm512_sqrt_ps(r2);
+    const auto f = _mm512_div_ps(_mm512_sub_ps(vh, r1), vh2);
+    const auto f3 = _mm512_mul_ps(_mm512_mul_ps(f, f), f);
+    _mm512_storeu_ps(w + k, _mm512_maskz_mov_ps(inside, _mm512_mul_ps(scale, f3)));
+  }
+
+  return k + spikyValuesAvx2(h, h2, x + k, y + k, z + k, count - k, w + k);
+}
+
+SPLASH_SIMD_TARGET("avx2")
+uint32_t spikyGradientsAvx2(float h, float h2, float h4, float h6, const float* x, const float* y, const float* z, uint32_t count, float* gx, float* gy, float* gz)
+{
+  const auto vh = _mm256_set1_ps(h);
+  const auto vh2 = _mm256_set1_ps(h2);
+  const auto scale = _mm256_set1_ps(-45.f / pi / h6);
+  const auto zero = _mm256_setzero_ps();
+
+  // Gradient at zero displacement, in the x direction
+  const auto centerScale = -45.f / pi / h4;
+  const auto centerX = _mm256_set1_ps(centerScale * 1.f);
+  const auto centerYZ = _mm256_set1_ps(centerScale * 0.f);
+
+  uint32_t k = 0;
+  for (; k + 8 <= count; k += 8)
+  {
+    const auto dx = _mm256_loadu_ps(x + k);
+    const auto dy = _mm256_loadu_ps(y + k);
+    const auto dz = _mm256_loadu_ps(z + k);
+    const auto r2 = squaredLength(dx, dy, dz);
+    const auto inside = _mm256_cmp_ps(r2, vh2, _CMP_LE_OQ);
+
+    const auto r1 = _mm256_sqrt_ps(r2);
+    const auto center = _mm256_cmp_ps(r1, zero, _CMP_EQ_OQ);
+    const auto hr = _mm256_sub_ps(vh, r1);
+    const auto s = _mm256_mul_ps(_mm256_mul_ps(scale, hr), hr);
+
+    const auto gradX = _mm256_blendv_ps(_mm256_mul_ps(s, _mm256_div_ps(dx, r1)), centerX, center);
+    const auto gradY = _mm256_blendv_ps(_mm256_mul_ps(s, _mm256_div_ps(dy, r1)), centerYZ, center);
+    const auto gradZ = _mm256_blendv_ps(_mm256_mul_ps(s, _mm256_div_ps(dz, r1)), centerYZ, center);
+    _mm256_storeu_ps(gx + k, _mm256_and_ps(gradX, inside));
+    _mm256_storeu_ps(gy + k, _mm256_and_ps(gradY, inside));
+    _mm256_storeu_ps(gz + k, _mm256_and_ps(gradZ, inside));
+  }
+  return k;
+}
+
+SPLASH_SIMD_TARGET("avx512f")
+uint32_t spikyGradientsAvx512(float h, float h2, float h4, float h6, const float* x, const float* y, const float* z, uint32_t count, float* gx, float* gy, float* gz)
+{
+  const auto vh = _mm512_set1_ps(h);
+  const auto vh2 = _mm512_set1_ps(h2);
+  const auto scale = _mm512_set1_ps(-45.f / pi / h6);
+  const auto zero = _mm512_setzero_ps();
+
+  const auto centerScale = -45.f / pi / h4;
+  const auto centerX = _mm512_set1_ps(centerScale * 1.f);
+  const auto centerYZ = _mm512_set1_ps(centerScale * 0.f);
+
+  uint32_t k = 0;
+  for (; k + 16 <= count; k += 16)
+  {
+    const auto dx = _mm512_loadu_ps(x + k);
+    const auto dy = _mm512_loadu_ps(y + k);
+    const auto dz = _mm512_loadu_ps(z + k);
+    const auto r2 = squaredLength(dx, dy, dz);
+    const auto inside = _mm512_cmp_ps_mask(r2, vh2, _CMP_LE_OQ);
+
+    const auto r1 = _mm512_sqrt_ps(r2);
+    const auto center = _mm512_cmp_ps_mask(r1, zero, _CMP_EQ_OQ);
+    const auto hr = _mm512_sub_ps(vh, r1);
+    const auto s = _mm512_mul_ps(_mm512_mul_ps(scale, hr), hr);
+
+    const auto gradX = _mm512_mask_blend_ps(center, _mm512_mul_ps(s, _mm512_div_ps(dx, r1)), centerX);
+    const auto gradY = _mm512_mask_blend_ps(center, _mm512_mul_ps(s, _mm512_div_ps(dy, r1)), centerYZ);
+    const auto gradZ = _mm512_mask_blend_ps(center, _mm512_mul_ps(s, _mm512_div_ps(dz, r1)), centerYZ);
+    _mm512_storeu_ps(gx + k, _mm512_maskz_mov_ps(inside, gradX));
+    _mm512_storeu_ps(gy + k, _mm512_maskz_mov_ps(inside, gradY));
+    _mm512_storeu_ps(gz + k, _mm512_maskz_mov_ps(inside, gradZ));
+  }
+
+  return k + spikyGradientsAvx2(h, h2, h4, h6, x + k, y + k, z + k, count - k, gx + k, gy + k, gz + k);
+}
+#endif
+}
+
+void SphKernel::evaluate(const float* x, const float* y, const float* z, uint32_t count, float* w) const
+{
+  for (uint32_t k = 0; k < count; k++)
+    w[k] = (*this)(glm::vec3(x[k], y[k], z[k]));
+}
+
+void SphKernel::evaluateGrad(const float* x, const float* y, const float* z, uint32_t count, float* gx, float* gy, float* gz) const
+{
+  for (uint32_t k = 0; k < count; k++)
+  {
+    const auto g = grad(glm::vec3(x[k], y[k], z[k]));
+    gx[k] = g.x;
+    gy[k] = g.y;
+    gz[k] = g.z;
+  }
+}
+
+void SphKernel::setInstructionSet(simd::InstructionSet instructionSet)
+{
+  instructionSet_ = simd::isSupported(instructionSet) ? instructionSet : simd::supportedInstructionSet();
+}
+
+void SphKernelPoly6::evaluate(const float* x, const float* y, const float* z, uint32_t count, float* w) const
+{
+  uint32_t k = 0;
+#ifdef SPLASH_SIMD_X86
+  if (instructionSet_ == simd::InstructionSet::AVX512)
+    k = poly6ValuesAvx512(h2_, h3_, x, y, z, count, w);
+  else if (instructionSet_ == simd::InstructionSet::AVX2)
+    k = poly6ValuesAvx2(h2_, h3_, x, y, z, count, w);
+#endif
+
+  for (; k < count; k++)
+    w[k] = SphKernelPoly6::operator()(glm::vec3(x[k], y[k], z[k]));
+}
+
+void SphKernelPoly6::evaluateGrad(const float* x, const float* y, const float* z, uint32_t count, float* gx, float* gy, float* gz) const
+{
+  uint32_t k = 0;
+#ifdef SPLASH_SIMD_X86
+  if (instructionSet_ == simd::InstructionSet::AVX512)
+    k = poly6GradientsAvx512(h_, h2_, h4_, x, y, z, count, gx, gy, gz);
+  else if (instructionSet_ == simd::InstructionSet::AVX2)
+    k = poly6GradientsAvx2(h_, h2_, h4_, x, y, z, count, gx, gy, gz);
+#endif
+
+  for (; k < count; k++)
+  {
+    const auto g = SphKernelPoly6::grad(glm::vec3(x[k], y[k], z[k]));
+    gx[k] = g.x;
+    gy[k] = g.y;
+    gz[k] = g.z;
+  }
+}
+
+void SphKernelSpiky::evaluate(const float* x, const float* y, const float* z, uint32_t count, float* w) const
+{
+  uint32_t k = 0;
+#ifdef SPLASH_SIMD_X86
+  if (instructionSet_ == simd::InstructionSet::AVX512)
+    k = spikyValuesAvx512(h_, h2_, x, y, z, count, w);
+  else if (instructionSet_ == simd::InstructionSet::AVX2)
+    k = spikyValuesAvx2(h_, h2_, x, y, z, count, w);
+#endif
+
+  for (; k < count; k++)
+    w[k] = SphKernelSpiky::operator()(glm::vec3(x[k], y[k], z[k]));
+}
+
+void SphKernelSpiky::evaluateGrad(const float* x, const float* y, const float* z, uint32_t count, float* gx, float* gy, float* gz) const
+{
+  uint32_t k = 0;
+#ifdef SPLASH_SIMD_X86
+  if (instructionSet_ == simd::InstructionSet::AVX512)
+    k = spikyGradientsAvx512(h_, h2_, h4_, h6_, x, y, z, count, gx, gy, gz);
+  else if (instructionSet_ == simd::InstructionSet::AVX2)
+    k = spikyGradientsAvx2(h_, h2_, h4_, h6_, x, y, z, count, gx, gy, gz);
+#endif
+
+  for (; k < count; k++)
+  {
+    const auto g = SphKernelSpiky::grad(glm::vec3(x[k], y[k], z[k]));
+    gx[k] = g.x;
+    gy[k] = g.y;
+    gz[k] = g.z;
+  }
+}
+}
+}
@@ -0,0 +1,92 @@
+#include <splash/fluid/timestep_controller.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace splash
+{
+namespace fluid
+{
+TimestepController::TimestepController() = default;
+
+TimestepController::~TimestepController() = default;
+
+void TimestepController::reset()
+{
+  accumulator_ = 0.f;
+  statistics_ = Statistics();
+}
+
+void TimestepController::advance(float frameTime, float wallTime, float h, const std::function<void(float)>& step, const std::function<float()>& maxSpeed)
+{
+  const auto start = std::chrono::high_resolution_clock::now();
+
+  statistics_.substeps = 0;
+  statistics_.simulatedTime = 0.f;
+  statistics_.droppedTime = 0.f;
+
+  accumulator_ += frameTime;
+  if (mode_ == Mode::FIXED)
+  {
+    while (accumulator_ >= fixedTimestep_ && statistics_.substeps < maxSubsteps_)
+    {
+      step(fixedTimestep_);
+      accumulator_ -= fixedTimestep_;
+      statistics_.simulatedTime += fixedTimestep_;
+      statistics_.timestep = fixedTimestep_;
+      statistics_.substeps++;
+    }
+
+    // Less than a timestep is carried over
+    if (accumulator_ >= fixedTimestep_)
+    {
+      statistics_.droppedTime = accumulator_ - std::fmod(accumulator_, fixedTimestep_);
+      accumulator_ -= statistics_.droppedTime;
+    }
+  }
+  else
+  {
+    // Timesteps stay within the CFL range, and the time left over is carried to the next frame
+    auto dt = maxTimestep_;
+    while (statistics_.substeps < maxSubsteps_)
+    {
+      dt = cflTimestep(h, maxSpeed());
+      if (accumulator_ < dt)
+        break;
+
+      step(dt);
+      accumulator_ -= dt;
+      statistics_.simulatedTime += dt;
+      statistics_.timestep = dt;
+      statistics_.substeps++;
+    }
+
+    // Less than the last timestep is carried over
+    if (accumulator_ >= dt)
+    {
+      statistics_.droppedTime = accumulator_ - std::fmod(accumulator_, dt);
+      accumulator_ -= statistics_.droppedTime;
+    }
+  }
+
+  const auto end = std::chrono::high_resolution_clock::now();
+  const auto stepMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+  statistics_.stepMilliseconds = statistics_.substeps > 0 ? stepMilliseconds / statistics_.substeps : 0.;
+
+  if (wallTime > 0.f)
+  {
+    constexpr double smoothing = 0.05;
+    const auto ratio = static_cast<double>(statistics_.simulatedTime) / wallTime;
+    statistics_.realTimeRatio += smoothing * (ratio - statistics_.realTimeRatio);
+  }
+}
+
+float TimestepController::cflTimestep(float h, float maxSpeed) const
+{
+  if (maxSpeed <= 0.f)
+    return maxTimestep_;
+  return std::clamp(cflNumber_ * h / maxSpeed, minTimestep_, maxTimestep_);
+}
+}
+}
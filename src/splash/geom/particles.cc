@@ -5,15 +5,100 @@ namespace splash
 namespace geom
 {
 Particles::Particles(uint32_t n)
-  : particles_(n)
 {
+  resize(n);
 }
 
 Particles::~Particles() = default;
 
+Particle Particles::get(int index) const
+{
+  Particle particle;
+  particle.position = position(index);
+  particle.type = types_[index];
+  particle.velocity = velocities_[index];
+  particle.mass = masses_[index];
+  particle.color = colors_[index];
+  particle.pad1 = 0.f;
+  return particle;
+}
+
+void Particles::set(int index, const Particle& particle)
+{
+  setPosition(index, particle.position);
+  types_[index] = particle.type;
+  velocities_[index] = particle.velocity;
+  masses_[index] = particle.mass;
+  colors_[index] = particle.color;
+}
+
+void Particles::pack(std::vector<Particle>& packed) const
+{
+  const auto n = size();
+  packed.resize(n);
+  for (int i = 0; i < n; i++)
+    packed[i] = get(i);
+}
+
 void Particles::resize(uint32_t n)
 {
-  particles_.resize(n);
+  const auto m = size();
+
+  x_.resize(n);
+  y_.resize(n);
+  z_.resize(n);
+  velocities_.resize(n);
+  masses_.resize(n);
+  types_.resize(n);
+  colors_.resize(n);
+
+  // Ids of removed particles are freed
+  for (uint32_t i = n; i < m; i++)
+    slots_[ids_[i]] = noSlot;
+  ids_.resize(n);
+
+  uint32_t id = 0;
+  for (uint32_t i = m; i < n; i++)
+  {
+    while (id < slots_.size() && slots_[id] != noSlot)
+      id++;
+    if (id == slots_.size())
+      slots_.push_back(noSlot);
+
+    ids_[i] = id;
+    slots_[id] = i;
+  }
+}
+
+template <typename T>
+void Particles::reorderArray(simd::AlignedVector<T>& values, simd::AlignedVector<T>& buffer, const std::vector<uint32_t>& order)
+{
+  const auto n = values.size();
+  buffer.resize(n);
+  for (int i = 0; i < n; i++)
+    buffer[i] = values[order[i]];
+  values.swap(buffer);
+}
+
+void Particles::reorder(const std::vector<uint32_t>& order)
+{
+  const auto n = size();
+
+  reorderArray(x_, reorderedFloats_, order);
+  reorderArray(y_, reorderedFloats_, order);
+  reorderArray(z_, reorderedFloats_, order);
+  reorderArray(velocities_, reorderedVectors_, order);
+  reorderArray(masses_, reorderedFloats_, order);
+  reorderArray(types_, reorderedTypes_, order);
+  reorderArray(colors_, reorderedVectors_, order);
+
+  reorderedIds_.resize(n);
+  for (int i = 0; i < n; i++)
+    reorderedIds_[i] = ids_[order[i]];
+  ids_.swap(reorderedIds_);
+
+  for (int i = 0; i < n; i++)
+    slots_[ids_[i]] = i;
 }
 }
 }
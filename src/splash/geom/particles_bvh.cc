@@ -1,6 +1,12 @@
 #include <splash/geom/particles_bvh.h>
 
 #include <algorithm>
+#include <limits>
+
+#include <tbb/tbb.h>
+
+#include <splash/geom/morton.h>
+#include <splash/parallel/primitives.h>
 
 namespace splash
 {
@@ -8,32 +14,29 @@ namespace geom
 {
 namespace
 {
-uint64_t splitBy3(uint32_t a)
+// Position of the most significant set bit
+uint32_t msb(uint64_t a)
 {
-  uint64_t x = a & 0x1fffff; // we only look at the first 21 bits
-  x = (x | x << 32) & 0x1f00000000ffff; // shift left 32 bits, OR with self, and 00011111000000000000000000000000000000001111111111111111
-  x = (x | x << 16) & 0x1f0000ff0000ff; // shift left 32 bits, OR with self, and 00011111000000000000000011111111000000000000000011111111
-  x = (x | x << 8) & 0x100f00f00f00f00f; // shift left 32 bits, OR with self, and 0001000000001111000000001111000000001111000000001111000000000000
-  x = (x | x << 4) & 0x10c30c30c30c30c3; // shift left 32 bits, OR with self, and 0001000011000011000011000011000011000011000011000011000100000000
-  x = (x | x << 2) & 0x1249249249249249;
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(a);
+#else
+  uint32_t x = 0;
+  for (uint32_t shift = 32; shift > 0; shift >>= 1)
+  {
+    if (a >> shift)
+    {
+      a >>= shift;
+      x += shift;
+    }
+  }
   return x;
+#endif
 }
 
-uint64_t morton(const glm::uvec3& p)
+float distance2(const glm::vec3& p, const glm::vec3& min, const glm::vec3& max)
 {
-  return splitBy3(p.x) | splitBy3(p.y) << 1 | splitBy3(p.z) << 2;
-}
-
-uint32_t clz(uint64_t a)
-{
-  uint64_t x = 0;
-  x |= (!!(a & 0xFFFFFFFF00000000)) << 5;
-  x |= (!!(a & 0xFFFF0000FFFF0000)) << 4;
-  x |= (!!(a & 0xFF00FF00FF00FF00)) << 3;
-  x |= (!!(a & 0xF0F0F0F0F0F0F0F0)) << 2;
-  x |= (!!(a & 0xCCCCCCCCCCCCCCCC)) << 1;
-  x |= (!!(a & 0xAAAAAAAAAAAAAAAA)) << 0;
-  return x;
+  const auto d = p - glm::clamp(p, min, max);
+  return glm::dot(d, d);
 }
 }
 
@@ -44,26 +47,199 @@ ParticlesBvh::~ParticlesBvh() = default;
 void ParticlesBvh::construct(const Particles& particles)
 {
   particles_ = &particles;
-  sorted_.resize(particles.size());
+
+  const auto n = particles.size();
+  positions_.resize(n);
+  indices_.resize(n);
+  nodes_.resize(n > 0 ? n - 1 : 0);
+  lastLeaves_.resize(nodes_.size());
+  if (n == 0)
+    return;
 
   computeBoundingBox();
   sortByMortonCode();
   computeTreeRanges();
+  computeNodeBoundingBoxes();
+}
+
+void ParticlesBvh::query(const glm::vec3& center, float radius, std::vector<uint32_t>& indices) const
+{
+  query(center, radius, 0, indices);
+}
+
+void ParticlesBvh::queryFollowingLeaves(int leaf, float radius, std::vector<uint32_t>& indices) const
+{
+  query(positions_[leaf], radius, leaf + 1, indices);
+}
+
+void ParticlesBvh::query(const glm::vec3& center, float radius, int firstLeaf, std::vector<uint32_t>& indices) const
+{
+  const auto n = size();
+  const auto radius2 = radius * radius;
+
+  if (n == 1)
+  {
+    if (firstLeaf == 0 && glm::dot(center - positions_[0], center - positions_[0]) <= radius2)
+      indices.push_back(indices_[0]);
+    return;
+  }
+  else if (n == 0 || firstLeaf >= n)
+    return;
+
+  // Depth is bounded by the bits of morton codes and of leaf indices
+  constexpr int maxDepth = 128;
+  int stack[maxDepth];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0)
+  {
+    const auto& node = nodes_[stack[--top]];
+
+    for (auto child : { node.left, node.right })
+    {
+      if (child < 0)
+      {
+        const auto leaf = ~child;
+        const auto& p = positions_[leaf];
+        if (leaf >= firstLeaf && glm::dot(center - p, center - p) <= radius2)
+          indices.push_back(indices_[leaf]);
+      }
+      else if (lastLeaves_[child] >= firstLeaf && distance2(center, nodes_[child].min, nodes_[child].max) <= radius2)
+        stack[top++] = child;
+    }
+  }
+}
+
+void ParticlesBvh::nearest(const glm::vec3& center, int k, std::vector<uint32_t>& indices) const
+{
+  const auto n = size();
+  k = std::min<int>(k, n);
+  if (k <= 0)
+    return;
+
+  // Max-heap of the nearest leaves so far, by squared distance
+  std::vector<std::pair<float, int>> heap;
+  heap.reserve(k);
+  const auto bound = [&]()
+  {
+    return heap.size() < k ? std::numeric_limits<float>::infinity() : heap.front().first;
+  };
+
+  const auto visitLeaf = [&](int leaf)
+  {
+    const auto& p = positions_[leaf];
+    const auto d2 = glm::dot(center - p, center - p);
+    if (heap.size() < k)
+    {
+      heap.emplace_back(d2, leaf);
+      std::push_heap(heap.begin(), heap.end());
+    }
+    else if (d2 < heap.front().first)
+    {
+      std::pop_heap(heap.begin(), heap.end());
+      heap.back() = { d2, leaf };
+      std::push_heap(heap.begin(), heap.end());
+    }
+  };
+
+  if (n == 1)
+    visitLeaf(0);
+  else
+  {
+    // Depth first with the nearer child first, pruning nodes farther than the k-th nearest leaf so far
+    constexpr int maxDepth = 128;
+    std::pair<float, int> stack[maxDepth];
+    int top = 0;
+    stack[top++] = { 0.f, 0 };
+
+    while (top > 0)
+    {
+      const auto entry = stack[--top];
+      if (entry.first > bound())
+        continue;
+
+      const auto& node = nodes_[entry.second];
+      std::pair<float, int> children[2];
+      int childCount = 0;
+      for (auto child : { node.left, node.right })
+      {
+        if (child < 0)
+          visitLeaf(~child);
+        else
+          children[childCount++] = { distance2(center, nodes_[child].min, nodes_[child].max), child };
+      }
+
+      if (childCount == 2 && children[0].first < children[1].first)
+        std::swap(children[0], children[1]);
+      for (int i = 0; i < childCount; i++)
+      {
+        if (children[i].first <= bound())
+          stack[top++] = children[i];
+      }
+    }
+  }
+
+  std::sort_heap(heap.begin(), heap.end());
+  for (const auto& entry : heap)
+    indices.push_back(indices_[entry.second]);
+}
+
+void ParticlesBvh::query(const std::vector<glm::vec3>& centers, float radius, std::vector<std::vector<uint32_t>>& indices) const
+{
+  indices.resize(centers.size());
+  forEach(0, centers.size(), [&](int i)
+    {
+      indices[i].clear();
+      query(centers[i], radius, indices[i]);
+    });
+}
+
+void ParticlesBvh::nearest(const std::vector<glm::vec3>& centers, int k, std::vector<std::vector<uint32_t>>& indices) const
+{
+  indices.resize(centers.size());
+  forEach(0, centers.size(), [&](int i)
+    {
+      indices[i].clear();
+      nearest(centers[i], k, indices[i]);
+    });
+}
+
+void ParticlesBvh::forEach(int begin, int end, std::function<void(int)> f) const
+{
+  parallel::forEach(begin, end, f, multiprocessing_);
 }
 
 void ParticlesBvh::computeBoundingBox()
 {
-  auto& particles = particles_->data();
+  const auto& particles = *particles_;
+  const int n = particles.size();
 
   // Compute bounding box of particle positions
-  min_ = particles[0].position;
-  max_ = particles[0].position;
-  for (const auto& particle : particles)
+  using Box = std::pair<glm::vec3, glm::vec3>;
+  const auto extend = [&](const tbb::blocked_range<int>& range, Box box)
+  {
+    for (int i = range.begin(); i < range.end(); i++)
+    {
+      const auto p = particles.position(i);
+      box.first = glm::min(box.first, p);
+      box.second = glm::max(box.second, p);
+    }
+    return box;
+  };
+
+  const Box initial{ particles.position(0), particles.position(0) };
+  Box box;
+  if (multiprocessing_)
   {
-    const auto& p = particle.position;
-    min_ = glm::min(min_, p);
-    max_ = glm::max(max_, p);
+    box = tbb::parallel_reduce(tbb::blocked_range<int>(0, n), initial, extend,
+      [](const Box& a, const Box& b) { return Box{ glm::min(a.first, b.first), glm::max(a.second, b.second) }; });
   }
+  else
+    box = extend(tbb::blocked_range<int>(0, n), initial);
+
+  min_ = box.first;
+  max_ = box.second;
 }
 
 void ParticlesBvh::sortByMortonCode()
@@ -72,22 +248,28 @@ void ParticlesBvh::sortByMortonCode()
   const auto n = particles.size();
 
   mortons_.resize(n);
-  for (int i = 0; i < n; i++)
-    mortons_[i] = { mortonCode(particles[i].position), i };
+  forEach(0, n, [&](int i)
+    {
+      mortons_[i] = mortonCode(particles.position(i));
+      indices_[i] = i;
+    });
 
-  std::sort(mortons_.begin(), mortons_.end());
+  // Indices start in increasing order, so equal codes stay ordered by particle index
+  radixSort_.setMultiprocessing(multiprocessing_);
+  radixSort_.sort(mortons_, indices_, 3 * mortonBits);
 
-  for (int i = 0; i < n; i++)
-    sorted_[i] = particles[mortons_[i].second];
+  forEach(0, n, [&](int i)
+    {
+      positions_[i] = particles.position(indices_[i]);
+    });
 }
 
 uint64_t ParticlesBvh::mortonCode(glm::vec3 p)
 {
-  // Normalize
-  p = (p - min_) / (max_ - min_);
+  // Normalize, with flat bounding boxes mapped to zero
+  p = (p - min_) / glm::max(max_ - min_, glm::vec3(1e-20f));
 
   // To integer coordinate
-  constexpr uint32_t mortonBits = 21;
   glm::uvec3 n = p * static_cast<float>(1 << mortonBits);
   n = glm::clamp(n, glm::uvec3(0), glm::uvec3((1 << mortonBits) - 1));
 
@@ -98,137 +280,109 @@ uint64_t ParticlesBvh::mortonCode(glm::vec3 p)
 void ParticlesBvh::computeTreeRanges()
 {
   const auto n = particles_->size();
-  ranges_.resize(n);
+  parents_.resize(2 * n - 1);
+  parents_[0] = -1;
 
-  ranges_[0].left = 0;
-  ranges_[0].right = n - 1;
+  // Each internal node is determined independently from the sorted codes
+  forEach(0, n - 1, [&](int i)
+    {
+      const auto range = findRange(i);
+      const auto split = findSplit(range);
 
-  // TODO: Run parallel loop
-  for (int i = 1; i < n - 1; i++)
-  {
-    const auto mortonPrev = mortons_[i - 1].first;
-    const auto mortonCur = mortons_[i].first;
-    const auto mortonNext = mortons_[i + 1].first;
+      lastLeaves_[i] = range.right;
 
-    const auto msb0 = clz(mortonPrev ^ mortonCur);
-    const auto msb1 = clz(mortonCur ^ mortonNext);
+      auto& node = nodes_[i];
+      node.left = split == range.left ? ~split : split;
+      node.right = split + 1 == range.right ? ~(split + 1) : split + 1;
 
-    if (msb0 > msb1)
-    {
-      // Split left
-      auto split = findSplit(0, i);
-      ranges_[i] = { split, i };
-    }
-    else if (msb0 < msb1)
-    {
-      // Split right
-      auto split = findSplit(i, n - 1);
-      ranges_[i] = { i, split };
-    }
-    else
-    {
-      // Same morton codes
-      ranges_[i] = { -1, -1 };
-    }
-  }
+      parents_[node.left < 0 ? n - 1 + ~node.left : node.left] = i;
+      parents_[node.right < 0 ? n - 1 + ~node.right : node.right] = i;
+    });
 }
 
-int ParticlesBvh::findSplit(int left, int right)
+void ParticlesBvh::computeNodeBoundingBoxes()
 {
-  auto mortonLeft = mortons_[left].first;
-  auto mortonRight = mortons_[right].first;
-
-  if (mortonLeft == mortonRight)
-    return (mortonLeft + mortonRight) >> 1;
-
-  const auto msb = clz(mortonLeft ^ mortonRight);
+  const auto n = particles_->size();
+  if (visits_.size() != n - 1)
+    visits_ = std::vector<std::atomic<int>>(n - 1);
 
-  int split = -1;
-  int mid;
-  while (left < right)
-  {
-    mid = (left + right) >> 1;
-    const auto mortonMid = mortons_[mid].first;
+  forEach(0, n - 1, [&](int i)
+    {
+      visits_[i].store(0, std::memory_order_relaxed);
+    });
 
-    const auto msb0 = clz(mortonLeft ^ mortonMid);
-    if (msb == msb0)
+  // Bottom-up from each leaf. The first thread to reach a node stops there,
+  // and the second one, seeing both children complete, continues to the parent.
+  forEach(0, n, [&](int i)
     {
-      split = mid;
-      right = mid - 1;
-    }
-    else
-      left = mid + 1;
-  }
+      auto node = parents_[n - 1 + i];
+      while (node >= 0 && visits_[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+      {
+        auto& bounds = nodes_[node];
+        const auto childMin = [&](int child) { return child < 0 ? positions_[~child] : nodes_[child].min; };
+        const auto childMax = [&](int child) { return child < 0 ? positions_[~child] : nodes_[child].max; };
+        bounds.min = glm::min(childMin(bounds.left), childMin(bounds.right));
+        bounds.max = glm::max(childMax(bounds.left), childMax(bounds.right));
 
-  return split;
+        node = parents_[node];
+      }
+    });
 }
 
-ParticlesBvh::Range ParticlesBvh::findRange(int pivot)
+int ParticlesBvh::commonPrefix(int i, int j) const
 {
-  const auto n = mortons_.size();
+  const int n = mortons_.size();
+  if (j < 0 || j >= n)
+    return -1;
 
-  const auto mortonPrev = mortons_[pivot - 1].first;
-  const auto mortonCur = mortons_[pivot].first;
-  const auto mortonNext = mortons_[pivot + 1].first;
+  const auto mortonI = mortons_[i];
+  const auto mortonJ = mortons_[j];
 
-  const auto msb0 = clz(mortonPrev ^ mortonCur);
-  const auto msb1 = clz(mortonCur ^ mortonNext);
+  // Ties of equal morton codes are broken by leaf index, as if appended to the codes
+  if (mortonI == mortonJ)
+    return 64 + 63 - msb(static_cast<uint64_t>(i ^ j));
 
-  Range range;
+  return 63 - msb(mortonI ^ mortonJ);
+}
 
-  if (msb0 > msb1)
+int ParticlesBvh::findSplit(const Range& range) const
+{
+  // Highest leaf sharing more than the common prefix of the range with its first leaf
+  const auto prefix = commonPrefix(range.left, range.right);
+
+  int split = range.left;
+  int step = range.right - range.left;
+  do
   {
-    int left = 0;
-    int right = pivot;
-    int split = -1;
-    while (left < right)
-    {
-      const auto mid = (left + right) >> 1;
-      const auto mortonMid = mortons_[mid].first;
-      const auto msb = clz(mortonCur ^ mortonMid);
+    step = (step + 1) >> 1;
+    const auto next = split + step;
+    if (next < range.right && commonPrefix(range.left, next) > prefix)
+      split = next;
+  } while (step > 1);
 
-      if (msb <= msb0)
-      {
-        split = mid;
-        right = mid - 1;
-      }
-      else
-        left = mid + 1;
-    }
+  return split;
+}
 
-    range.left = split;
-    range.right = pivot;
-  }
-  else if (msb0 < msb1)
-  {
-    int left = pivot;
-    int right = n - 1;
-    int split = -1;
-    while (left < right)
-    {
-      const auto mid = (left + right) >> 1;
-      const auto mortonMid = mortons_[mid].first;
-      const auto msb = clz(mortonCur ^ mortonMid);
+ParticlesBvh::Range ParticlesBvh::findRange(int pivot) const
+{
+  // Direction of the range, towards the neighbor of longer common prefix
+  const auto direction = commonPrefix(pivot, pivot + 1) > commonPrefix(pivot, pivot - 1) ? 1 : -1;
+  const auto minPrefix = commonPrefix(pivot, pivot - direction);
 
-      if (msb <= msb1)
-      {
-        split = mid;
-        left = mid + 1;
-      }
-      else
-        right = mid - 1;
-    }
+  // Exponential then binary search for the other end
+  int maxLength = 2;
+  while (commonPrefix(pivot, pivot + maxLength * direction) > minPrefix)
+    maxLength *= 2;
 
-    range.left = pivot;
-    range.right = split;
-  }
-  else
+  int length = 0;
+  for (int step = maxLength / 2; step >= 1; step /= 2)
   {
-    // Same morton codes
-    range = { -1, -1 };
+    if (commonPrefix(pivot, pivot + (length + step) * direction) > minPrefix)
+      length += step;
   }
 
-  return range;
+  const auto other = pivot + length * direction;
+  return { std::min(pivot, other), std::max(pivot, other) };
 }
 }
 }
@@ -108,9 +108,10 @@ ParticlesGeometry::~ParticlesGeometry()
 void ParticlesGeometry::update(const geom::Particles& particles)
 {
   particleCount_ = particles.size();
+  particles.pack(instances_);
 
   glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, particleCount_ * sizeof(geom::Particle), &particles[0]);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, particleCount_ * sizeof(geom::Particle), instances_.data());
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -0,0 +1,127 @@
+#include <splash/parallel/primitives_benchmark.h>
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <random>
+
+#include <tbb/tbb.h>
+
+#include <splash/parallel/primitives.h>
+
+namespace splash
+{
+namespace parallel
+{
+PrimitivesBenchmark::PrimitivesBenchmark() = default;
+
+PrimitivesBenchmark::~PrimitivesBenchmark() = default;
+
+void PrimitivesBenchmark::measureScaling(int n)
+{
+  timings_.clear();
+
+  // Random counts, flags, bins and 64-bit keys, as in neighbor counts, particle types, cells and morton codes
+  std::mt19937 generator(0);
+  std::vector<uint32_t> counts(n);
+  std::vector<uint64_t> keys(n);
+  for (int i = 0; i < n; i++)
+  {
+    counts[i] = generator() % 64;
+    keys[i] = (static_cast<uint64_t>(generator()) << 32) | generator();
+  }
+
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> compacted(n);
+  std::vector<uint32_t> histogramCounts;
+  std::vector<uint64_t> sortedKeys;
+  std::vector<uint32_t> sortedValues;
+  RadixSort<uint64_t, uint32_t> radixSort;
+
+  const std::vector<std::pair<std::string, std::function<void(bool)>>> primitives = {
+    { "scan", [&](bool multiprocessing)
+      {
+        exclusiveScan(counts, offsets, multiprocessing);
+      } },
+    { "compact", [&](bool multiprocessing)
+      {
+        compact(n, [&](int i) { return counts[i] < 32; }, compacted.data(), multiprocessing);
+      } },
+    { "histogram", [&](bool multiprocessing)
+      {
+        histogram(n, [&](int i) { return counts[i]; }, 64, histogramCounts, multiprocessing);
+      } },
+    { "radix sort", [&](bool multiprocessing)
+      {
+        sortedKeys = keys;
+        sortedValues.resize(n);
+        for (int i = 0; i < n; i++)
+          sortedValues[i] = i;
+
+        radixSort.setMultiprocessing(multiprocessing);
+        radixSort.sort(sortedKeys, sortedValues);
+      } },
+  };
+
+  const auto maxThreads = tbb::this_task_arena::max_concurrency();
+
+  std::vector<int> threadCounts;
+  for (int threads = 1; threads < maxThreads; threads *= 2)
+    threadCounts.push_back(threads);
+  threadCounts.push_back(maxThreads);
+
+  for (const auto& primitive : primitives)
+  {
+    const auto measure = [&](bool multiprocessing)
+    {
+      // Warm up caches and buffers
+      primitive.second(multiprocessing);
+
+      const auto start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < repeats_; i++)
+        primitive.second(multiprocessing);
+      const auto end = std::chrono::high_resolution_clock::now();
+
+      return std::chrono::duration<double, std::milli>(end - start).count() / repeats_;
+    };
+
+    // Serial loop as the baseline, with 0 threads
+    Timing serial;
+    serial.primitive = primitive.first;
+    serial.milliseconds = measure(false);
+    timings_.push_back(serial);
+
+    for (auto threads : threadCounts)
+    {
+      tbb::task_arena arena(threads);
+
+      Timing timing;
+      timing.primitive = primitive.first;
+      timing.threads = threads;
+      arena.execute([&]
+        {
+          timing.milliseconds = measure(true);
+        });
+      timing.speedup = serial.milliseconds / timing.milliseconds;
+      timings_.push_back(timing);
+    }
+  }
+}
+
+void PrimitivesBenchmark::printReport(std::ostream& out) const
+{
+  out << "Parallel primitives scaling report" << std::endl;
+  out << std::setw(12) << "primitive" << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(10) << "speedup" << std::endl;
+  for (const auto& timing : timings_)
+  {
+    out << std::setw(12) << timing.primitive;
+    if (timing.threads == 0)
+      out << std::setw(8) << "serial";
+    else
+      out << std::setw(8) << timing.threads;
+    out << std::setw(12) << std::fixed << std::setprecision(3) << timing.milliseconds
+      << std::setw(9) << std::setprecision(2) << timing.speedup << "x" << std::endl;
+  }
+}
+}
+}
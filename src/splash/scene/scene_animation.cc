@@ -156,9 +156,9 @@ void SceneAnimation::updateParticles(float animationTime)
     const auto cosT = std::cos(animationTime * speed * t);
     const auto sinT = std::sin(animationTime * speed * t);
 
-    particles[i].position = { t * cosT, t * sinT, t };
-    particles[i].velocity = { 0.f, 0.f, 0.f }; // TODO
-    particles[i].color = { 0.f, 0.f, t };
+    particles.setPosition(i, { t * cosT, t * sinT, t });
+    particles.velocity(i) = { 0.f, 0.f, 0.f }; // TODO
+    particles.color(i) = { 0.f, 0.f, t };
   }
 
   particlesGeometry_->update(particles);
@@ -171,7 +171,7 @@ void SceneAnimation::updateParticles(float animationTime)
     std::vector<model::Box> boxes;
     for (int i = 0; i < particleCount_; i++)
     {
-      const auto& p = particles[i].position;
+      const auto p = particles.position(i);
 
       model::Box box;
       box.min = p - glm::vec3(r);
@@ -1,14 +1,13 @@
 #include <splash/scene/scene_fluid.h>
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
-#define NOMINMAX
-#include <tbb/tbb.h>
-
 #include <splash/gl/shaders.h>
 #include <splash/gl/shader.h>
 #include <splash/gl/texture.h>
@@ -18,7 +17,15 @@
 #include <splash/model/camera.h>
 #include <splash/scene/resources.h>
 #include <splash/fluid/neighbor_search_spatial_hashing.h>
+#include <splash/fluid/neighbor_search_uniform_grid.h>
+#include <splash/fluid/neighbor_search_naive.h>
+#include <splash/fluid/neighbor_search_bvh.h>
+#include <splash/fluid/neighbor_search_multi_level_grid.h>
+#include <splash/fluid/neighbor_search_sparse_grid.h>
+#include <splash/fluid/pbf_solver.h>
 #include <splash/fluid/sph_kernel.h>
+#include <splash/fluid/timestep_controller.h>
+#include <splash/parallel/primitives.h>
 
 namespace splash
 {
@@ -35,7 +42,15 @@ SceneFluid::SceneFluid(Resources* resources, gl::Shaders* shaders)
 
   lastTime_ = std::chrono::high_resolution_clock::now();
 
-  neighborSearch_ = std::make_unique<fluid::NeighborSearchSpatialHashing>();
+  neighborSearches_.resize(6);
+  neighborSearches_[0] = std::make_unique<fluid::NeighborSearchSpatialHashing>();
+  neighborSearches_[1] = std::make_unique<fluid::NeighborSearchUniformGrid>();
+  neighborSearches_[2] = std::make_unique<fluid::NeighborSearchNaive>();
+  neighborSearches_[3] = std::make_unique<fluid::NeighborSearchBvh>();
+  neighborSearches_[4] = std::make_unique<fluid::NeighborSearchMultiLevelGrid>();
+  neighborSearches_[5] = std::make_unique<fluid::NeighborSearchSparseGrid>();
+  solver_ = std::make_unique<fluid::PbfSolver>();
+  timestepController_ = std::make_unique<fluid::TimestepController>();
 
   initializeParticles();
 }
@@ -54,6 +69,12 @@ void SceneFluid::drawUi()
     initializeParticles();
   }
 
+  if (ImGui::Checkbox("Periodic X", &periodicX_))
+  {
+    waveAnimationTime_ = 0.f;
+    initializeParticles();
+  }
+
   ImGui::Text("%d fluid particles", fluidCount_);
   ImGui::Text("%d boundary particles", particleCount_ - fluidCount_);
   ImGui::Text("%d total particles", particleCount_);
@@ -64,6 +85,13 @@ void SceneFluid::drawUi()
 
   ImGui::Checkbox("Multiprocessing", &multiprocessing_);
 
+  ImGui::Checkbox("Symmetric neighbors", &symmetricNeighbors_);
+
+  ImGui::SliderFloat("Neighbor skin", &neighborSkin_, 0.f, 0.5f, "%.2f h");
+  ImGui::Text("Neighbor rebuilds %d / %d steps", solver_->neighborRebuildCount(), solver_->neighborUpdateCount());
+
+  ImGui::SliderInt("Reorder every N steps", &reorderInterval_, 0, 100);
+
   static const std::vector<float> timestepScaleTable{
     1.f,
     1.7f,
@@ -76,6 +104,40 @@ void SceneFluid::drawUi()
   timestepScale_ = timestepScaleTable[timestepScaleLevel_];
   ImGui::Text("Animation speed X%.1lf", timestepScale_);
 
+  auto& timestepController = *timestepController_;
+  const auto timestepMode = timestepController.mode();
+  ImGui::Text("Timestep");
+  ImGui::PushID(3);
+  ImGui::SameLine();
+  if (ImGui::RadioButton("Fixed", timestepMode == fluid::TimestepController::Mode::FIXED))
+    timestepController.setMode(fluid::TimestepController::Mode::FIXED);
+  ImGui::SameLine();
+  if (ImGui::RadioButton("CFL", timestepMode == fluid::TimestepController::Mode::CFL))
+    timestepController.setMode(fluid::TimestepController::Mode::CFL);
+  ImGui::PopID();
+
+  if (timestepMode == fluid::TimestepController::Mode::FIXED)
+  {
+    auto fixedTimestep = timestepController.fixedTimestep() * 1000.f;
+    if (ImGui::SliderFloat("Fixed timestep", &fixedTimestep, 1.f, 33.f, "%.1f ms"))
+      timestepController.setFixedTimestep(fixedTimestep / 1000.f);
+  }
+  else
+  {
+    auto cflNumber = timestepController.cflNumber();
+    if (ImGui::SliderFloat("CFL number", &cflNumber, 0.05f, 1.f))
+      timestepController.setCflNumber(cflNumber);
+  }
+
+  auto maxSubsteps = timestepController.maxSubsteps();
+  if (ImGui::SliderInt("Max substeps", &maxSubsteps, 1, 16))
+    timestepController.setMaxSubsteps(maxSubsteps);
+
+  const auto& timestepStatistics = timestepController.statistics();
+  ImGui::Text("%d substeps of %.2f ms, %.3lf ms per substep",
+    timestepStatistics.substeps, timestepStatistics.timestep * 1000.f, timestepStatistics.stepMilliseconds);
+  ImGui::Text("Simulated / wall time %.2lf", timestepStatistics.realTimeRatio);
+
   ImGui::Checkbox("Wave", &wave_);
   ImGui::SliderFloat("Wave speed", &waveSpeed_, 0.f, 5.f);
 
@@ -106,21 +168,60 @@ void SceneFluid::drawUi()
   ImGui::PopID();
 
   ImGui::SliderFloat("Viscosity", &viscosity_, 0.f, 1.f);
+
+  static std::vector<std::string> neighborSearches{
+    "Spatial hashing",
+    "Uniform grid",
+    "Naive",
+    "BVH",
+    "Multi-level grid",
+    "Sparse grid",
+  };
+
+  ImGui::Text("Neighbor search");
+  ImGui::PushID(2);
+  for (int i = 0; i < neighborSearches.size(); i++)
+  {
+    ImGui::SameLine();
+    if (ImGui::RadioButton(neighborSearches[i].c_str(), neighborSearchIndex_ == i))
+      neighborSearchIndex_ = i;
+  }
+  ImGui::PopID();
+
+  if (periodicX_ && !neighborSearches_[neighborSearchIndex_]->supportsPeriodicDomain())
+    ImGui::Text("Periodic X falls back to spatial hashing");
+
+  ImGui::Checkbox("Neighbor statistics", &neighborStatistics_);
+  const auto& statistics = neighborSearch().statistics();
+  ImGui::Text("Build %.3lf ms, query %.3lf ms", statistics.buildMilliseconds, statistics.queryMilliseconds);
+  if (neighborStatistics_)
+  {
+    ImGui::Text("%llu pairs, neighbors min %u mean %.1f max %u",
+      static_cast<unsigned long long>(statistics.pairCount), statistics.minNeighbors, statistics.meanNeighbors, statistics.maxNeighbors);
+
+    if (statistics.occupiedCells > 0)
+    {
+      ImGui::Text("%u occupied cells, %.1f%% hash collisions", statistics.occupiedCells, statistics.collisionRate * 100.f);
+
+      std::vector<float> histogram(statistics.particlesPerCell.begin(), statistics.particlesPerCell.end());
+      ImGui::PlotHistogram("Particles per cell", histogram.data(), histogram.size(), 0, "1 to 16+", 0.f);
+    }
+  }
 }
 
 void SceneFluid::draw()
 {
   const auto now = std::chrono::high_resolution_clock::now();
-  auto dt = std::chrono::duration<float>(now - lastTime_).count();
+  const auto wallTime = std::chrono::duration<float>(now - lastTime_).count();
   lastTime_ = now;
 
   // Slow motion
-  dt /= timestepScale_;
+  const auto frameTime = wallTime / timestepScale_;
 
   if (animation_)
-    animationTime_ += dt;
+    animationTime_ += frameTime;
 
-  updateParticles(dt);
+  updateParticles(frameTime, wallTime);
 
   auto& camera = resources_->camera();
 
@@ -194,19 +295,30 @@ void SceneFluid::initializeParticles()
   constexpr float radius = 0.1f;
 
   particles.radius() = radius;
+  const auto h = radius * 4.f;
+
+  // Minimum images need a periodic extent of at least 2 h
+  if (periodicX_)
+  {
+    const auto minSideX = static_cast<int>(std::ceil(2.f * h / (3 * 2.f * radius)));
+    fluidSideX_ = std::max(fluidSideX_, minSideX);
+  }
 
   fluidCount_ = fluidSideX_ * fluidSideY_ * fluidSideZ_;
-  particleCount_ = fluidCount_ + (fluidSideX_ * 3 * fluidSideY_ + fluidSideY_ * fluidSideZ_ + fluidSideZ_ * fluidSideX_ * 3) * 2;
+  // Periodic along x without the walls at both ends of x
+  const auto wallCountX = periodicX_ ? 0 : fluidSideY_ * fluidSideZ_;
+  particleCount_ = fluidCount_ + (fluidSideX_ * 3 * fluidSideY_ + wallCountX + fluidSideZ_ * fluidSideX_ * 3) * 2;
   particles.resize(particleCount_);
 
   // Kernels
-  const auto h = radius * 4.f;
   kernels_.resize(3);
   kernels_[0] = std::make_unique<fluid::SphKernelPoly6>(h);
   kernels_[1] = std::make_unique<fluid::SphKernelSpiky>(h);
   kernels_[2] = std::make_unique<fluid::SphKernelSpiky>(h); // TODO: change to cubic
 
   rho0_ = 997.f;
+  solver_->invalidateBoundaryVolumes();
+  timestepController_->reset();
 
   constexpr float pi = 3.1415926535897932384626433832795f;
   const auto mass = 0.8 * rho0_ * 8.f * radius * radius * radius; // Cubic particle
@@ -221,18 +333,19 @@ void SceneFluid::initializeParticles()
       {
         const auto index = i * fluidSideY_ * fluidSideZ_ + j * fluidSideZ_ + k;
 
-        auto& particle = particles[index];
+        geom::Particle particle{};
         particle.type = geom::ParticleType::FLUID;
         particle.position = glm::vec3(i + 1, j + 1, k + 1) * 2.f * radius;
         particle.mass = mass;
         particle.velocity = { 0.f, 0.f, 0.f };
         particle.color = { 0.f, 0.f, 1.f };
+        particles.set(index, particle);
       }
     }
   }
 
   // Boundary generation
-  geom::Particle boundaryParticle;
+  geom::Particle boundaryParticle{};
   boundaryParticle.type = geom::ParticleType::BOUNDARY;
   boundaryParticle.mass = 0.f;
   boundaryParticle.color = glm::vec3(101.f, 67.f, 33.f) / 255.f;
@@ -246,10 +359,10 @@ void SceneFluid::initializeParticles()
       const auto b = glm::vec3(i + 1, j + 1, 0.f) * 2.f * radius;
 
       boundaryParticle.position = glm::vec3(b.x, b.y, b.z);
-      particles[index++] = boundaryParticle;
+      particles.set(index++, boundaryParticle);
 
       boundaryParticle.position = glm::vec3(b.x, b.y, b.z + (fluidSideZ_ + 1) * 2.f * radius);
-      particles[index++] = boundaryParticle;
+      particles.set(index++, boundaryParticle);
     }
   }
 
@@ -260,13 +373,23 @@ void SceneFluid::initializeParticles()
       const auto b = glm::vec3(i + 1, j + 1, 0.f) * 2.f * radius;
 
       boundaryParticle.position = glm::vec3(b.x, b.z, b.y);
-      particles[index++] = boundaryParticle;
+      particles.set(index++, boundaryParticle);
 
       boundaryParticle.position = glm::vec3(b.x, b.z + (fluidSideY_ + 1) * 2.f * radius, b.y);
-      particles[index++] = boundaryParticle;
+      particles.set(index++, boundaryParticle);
     }
   }
 
+  if (periodicX_)
+  {
+    // Walls along x repeat with the spacing of their particles
+    const auto minX = radius;
+    const auto maxX = minX + fluidSideX_ * 3 * 2.f * radius;
+    periodicDomain_ = fluid::PeriodicDomain({ true, false, false }, glm::vec3(minX, 0.f, 0.f), glm::vec3(maxX, 0.f, 0.f));
+    return;
+  }
+
+  periodicDomain_ = fluid::PeriodicDomain();
   for (int i = 0; i < fluidSideY_; i++)
   {
     for (int j = 0; j < fluidSideZ_; j++)
@@ -275,16 +398,16 @@ void SceneFluid::initializeParticles()
 
       boundaryParticle.position = glm::vec3(b.z, b.x, b.y);
       boundaryParticle.velocity = { 1.f, 0.f, 0.f };
-      particles[index++] = boundaryParticle;
+      particles.set(index++, boundaryParticle);
       boundaryParticle.velocity = { 0.f, 0.f, 0.f };
 
       boundaryParticle.position = glm::vec3(b.z + (fluidSideX_ * 3 + 1) * 2.f * radius, b.x, b.y);
-      particles[index++] = boundaryParticle;
+      particles.set(index++, boundaryParticle);
     }
   }
 }
 
-void SceneFluid::updateParticles(float dt)
+void SceneFluid::updateParticles(float frameTime, float wallTime)
 {
   auto& particles = *particles_;
   const auto radius = particles_->radius();
@@ -293,239 +416,62 @@ void SceneFluid::updateParticles(float dt)
   {
     const auto n = particles.size();
 
-    // Boundary wave animation
-    if (wave_)
+    fluid::PbfSolver::Parameters parameters;
+    parameters.h = 4.f * radius;
+    parameters.restDensity = rho0_;
+    parameters.viscosity = viscosity_;
+    parameters.neighborSkin = neighborSkin_;
+    parameters.symmetricNeighbors = symmetricNeighbors_;
+    parameters.reorderInterval = reorderInterval_;
+    parameters.periodicDomain = periodicDomain_;
+
+    auto& neighborSearch = this->neighborSearch();
+    neighborSearch.setStatisticsEnabled(neighborStatistics_);
+
+    solver_->setMultiprocessing(multiprocessing_);
+    solver_->setParameters(parameters);
+    solver_->setKernels(kernels_[kernelIndex_].get(), kernels_[gradKernelIndex_].get());
+    solver_->setNeighborSearch(&neighborSearch);
+
+    // Solver timesteps are independent of the frame time
+    const auto step = [&](float dt)
     {
-      waveAnimationTime_ += dt * waveSpeed_;
-      constexpr float amplitude = 1.f;
-      for (int i = 0; i < n; i++)
+      // Boundary wave animation
+      if (wave_)
       {
-        if (particles[i].type == geom::ParticleType::BOUNDARY && particles[i].velocity.x != 0.f)
-          particles[i].position.x = (1.f - std::cos(waveAnimationTime_)) / 2.f * amplitude;
-      }
-    }
-
-    const auto& kernel = *kernels_[kernelIndex_];
-    const auto& gradKernel = *kernels_[gradKernelIndex_];
-
-    constexpr glm::vec3 gravity = { 0.f, 0.f, -9.80665f };
-    positions_.resize(n);
-    for (int i = 0; i < n; i++)
-    {
-      // Store old particle positions
-      positions_[i] = particles[i].position;
-
-      // Update particles
-      if (particles[i].type == geom::ParticleType::FLUID)
-      {
-        particles[i].velocity += gravity * dt;
-        particles[i].position += particles[i].velocity * dt;
-      }
-    }
-
-    // Neighbor search
-    {
-      const auto h = 4.f * radius; // SPH support radius
-      neighborSearch_->setMultiprocessing(multiprocessing_);
-      neighborSearch_->computeNeighbors(particles, h);
-      const auto& neighbors = neighborSearch_->neighbors();
-
-      neighborIndices_.resize(n);
-      forEach(0, n, [&](int i) {
-        neighborIndices_[i].clear();
-        });
-
-      for (auto neighbor : neighbors)
-      {
-        const auto i0 = neighbor.i0;
-        const auto i1 = neighbor.i1;
-
-        neighborIndices_[i0].push_back(i1);
-      }
-    }
-
-    // TODO: Move fluid simulation to a class
-    // Split fluid and boundary
-    fluidIndices_.clear();
-    boundaryIndices_.clear();
-    toFluidIndex_.resize(n);
-    for (int i = 0; i < n; i++)
-    {
-      if (particles[i].type == geom::ParticleType::FLUID)
-      {
-        toFluidIndex_[i] = fluidIndices_.size();
-        fluidIndices_.push_back(i);
-      }
-      else
-      {
-        toFluidIndex_[i] = -1;
-        boundaryIndices_.push_back(i);
-      }
-    }
-
-    const auto n0 = fluidIndices_.size();
-    const auto n1 = boundaryIndices_.size();
-
-    density_.resize(n0);
-    incompressibilityLambdas_.resize(n0);
-    deltaP_.resize(n0);
-
-    // Compute boundary psi
-    forEach(0, n1, [&](int i)
-      {
-        const auto i0 = boundaryIndices_[i];
-
-        float delta = kernel(glm::vec3(0.f));
-
-        for (auto i1 : neighborIndices_[i0])
+        waveAnimationTime_ += dt * waveSpeed_;
+        constexpr float amplitude = 1.f;
+        for (int i = 0; i < n; i++)
         {
-          if (particles[i1].type == geom::ParticleType::BOUNDARY)
+          if (particles.type(i) == geom::ParticleType::BOUNDARY && particles.velocity(i).x != 0.f)
           {
-            const auto& p0 = particles[i0].position;
-            const auto& p1 = particles[i1].position;
-
-            delta += kernel(p0 - p1);
+            auto position = particles.position(i);
+            position.x = (1.f - std::cos(waveAnimationTime_)) / 2.f * amplitude;
+            particles.setPosition(i, position);
           }
         }
 
-        const auto volume = 1.f / delta;
-
-        // Update boundary particle mass
-        particles[i0].mass = rho0_ * volume;
-      });
-
-    // Projection steps
-    constexpr uint32_t maxSteps = 5;
-    for (int step = 0; step < maxSteps; step++)
-    {
-      // Density calculation
-      forEach(0, n0, [&](int i)
-        {
-          const auto i0 = fluidIndices_[i];
-
-          // Contribution from self
-          density_[i] = particles[i0].mass * kernel(glm::vec3(0.f));
-
-          // Contribution from neighbors
-          for (auto i1 : neighborIndices_[i0])
-          {
-            const auto& p0 = particles[i0].position;
-            const auto& p1 = particles[i1].position;
-
-            density_[i] += particles[i1].mass * kernel(p0 - p1);
-          }
-        });
-
-      // Solve project to make incompressibility = 0
-      forEach(0, n0, [&](int i)
-        {
-          const auto i0 = fluidIndices_[i];
-
-          const auto incompressibility = std::max(density_[i] / rho0_ - 1.f, 0.f);
-          if (incompressibility > 0.f)
-          {
-            glm::vec3 selfGrad(0.f);
-            float denom = 0.f;
-
-            for (auto i1 : neighborIndices_[i0])
-            {
-              const auto& p0 = particles[i0].position;
-              const auto& p1 = particles[i1].position;
-
-              const auto m1 = particles[i1].mass;
-
-              const glm::vec3 grad0 = 1.f / rho0_ * m1 * gradKernel.grad(p0 - p1);
-              const glm::vec3 grad1 = -1.f / rho0_ * m1 * gradKernel.grad(p0 - p1);
-
-              // Add to gradient by self
-              selfGrad += grad0;
-
-              // Add to denominator for movable fluid particles
-              if (particles[i1].type == geom::ParticleType::FLUID)
-                denom += glm::dot(grad1, grad1);
-            }
-
-            denom += glm::dot(selfGrad, selfGrad);
-
-            // Compute lambdas
-            incompressibilityLambdas_[i] = -incompressibility / denom;
-          }
-          else
-            incompressibilityLambdas_[i] = 0.f;
-        });
-
-      // Compte delta p
-      for (int i = 0; i < n0; i++)
-        deltaP_[i] = glm::vec3(0.f);
-
-      forEach(0, n0, [&](int i)
-        {
-          const auto i0 = fluidIndices_[i];
-
-          for (auto i1 : neighborIndices_[i0])
-          {
-            const auto& p0 = particles[i0].position;
-            const auto& p1 = particles[i1].position;
-
-            const auto m1 = particles[i1].mass;
-
-            if (particles[i1].type == geom::ParticleType::FLUID)
-              deltaP_[i] += 1.f / rho0_ * (incompressibilityLambdas_[i] + incompressibilityLambdas_[toFluidIndex_[i1]]) * m1 * gradKernel.grad(p0 - p1);
-            else
-              deltaP_[i] += 1.f / rho0_ * incompressibilityLambdas_[i] * m1 * gradKernel.grad(p0 - p1);
-          }
-        });
-
-      // Update positions
-      forEach(0, n0, [&](int i)
-        {
-          const auto i0 = fluidIndices_[i];
-          particles[i0].position += deltaP_[i];
-        });
-    }
-
-    // Update velocity
-    forEach(0, n0, [&](int i)
-      {
-        const auto i0 = fluidIndices_[i];
-        particles[i0].velocity = (particles[i0].position - positions_[i0]) / dt;
-      });
-
-    // Solve viscosity
-    for (int i = 0; i < n0; i++)
-    {
-      const auto i0 = fluidIndices_[i];
-
-      for (auto i1 : neighborIndices_[i0])
-      {
-        if (particles[i1].type == geom::ParticleType::FLUID)
-        {
-          const auto& p0 = particles[i0].position;
-          const auto& p1 = particles[i1].position;
-
-          const auto& v0 = particles[i0].velocity;
-          const auto& v1 = particles[i1].velocity;
-
-          const auto m1 = particles[i1].mass;
+        // Moving boundary particles change their volumes
+        solver_->invalidateBoundaryVolumes();
+      }
 
-          const auto density1 = density_[toFluidIndex_[i1]];
+      solver_->step(particles, dt);
+    };
 
-          particles[i0].velocity -= viscosity_ * (m1 / density1) * (v0 - v1) * kernel(p0 - p1);
-        }
-      }
-    }
+    const auto maxSpeed = [&]() { return solver_->maxSpeed(particles); };
+    timestepController_->advance(frameTime, wallTime, parameters.h, step, maxSpeed);
   }
 
   // Update color mapped with velocity
   constexpr float vmax = 3.f;
   for (int i = 0; i < particles.size(); i++)
   {
-    if (particles[i].type == geom::ParticleType::FLUID)
+    if (particles.type(i) == geom::ParticleType::FLUID)
     {
-      const auto v2 = glm::dot(particles[i].velocity, particles[i].velocity);
+      const auto v2 = glm::dot(particles.velocity(i), particles.velocity(i));
       const auto v = std::sqrt(v2);
       const auto t = std::min(v / vmax, 1.f);
-      particles[i].color = glm::vec3(t, t, 1.f);
+      particles.color(i) = glm::vec3(t, t, 1.f);
     }
   }
 
@@ -539,36 +485,29 @@ void SceneFluid::updateParticles(float dt)
   }
 }
 
+fluid::NeighborSearch& SceneFluid::neighborSearch()
+{
+  auto& neighborSearch = *neighborSearches_[neighborSearchIndex_];
+  if (periodicX_ && !neighborSearch.supportsPeriodicDomain())
+    return *neighborSearches_[0];
+  return neighborSearch;
+}
+
 void SceneFluid::updateFluidParticles()
 {
   fluidParticles_->radius() = particles_->radius();
   fluidParticles_->resize(fluidCount_);
 
-  int index = 0;
-  for (int i = 0; i < particles_->size(); i++)
-  {
-    if ((*particles_)[i].type == geom::ParticleType::FLUID)
-      (*fluidParticles_)[index++] = (*particles_)[i];
-  }
-}
-
-void SceneFluid::forEach(int begin, int end, std::function<void(int)> f)
-{
-  // TODO: multiprocessing
-  if (multiprocessing_)
-  {
-    tbb::parallel_for(tbb::blocked_range<int>(begin, end),
-      [&](const tbb::blocked_range<int>& range)
-      {
-        for (int i = range.begin(); i < range.end(); i++)
-          f(i);
-      });
-  }
-  else
-  {
-    for (int i = begin; i < end; i++)
-      f(i);
-  }
+  const auto& particles = *particles_;
+  auto& fluidParticles = *fluidParticles_;
+  parallel::exclusiveScan<int>(particles.size(),
+    [&](int i) { return particles.type(i) == geom::ParticleType::FLUID ? 1 : 0; },
+    [&](int i, int index)
+    {
+      if (particles.type(i) == geom::ParticleType::FLUID)
+        fluidParticles.set(index, particles.get(i));
+    },
+    multiprocessing_);
 }
 }
 }
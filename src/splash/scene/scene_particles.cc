@@ -48,11 +48,12 @@ void SceneParticles::initializeParticles()
       const auto v = static_cast<float>(j) / particleCountY_;
 
       const auto index = i * particleCountY_ + j;
-      auto& particle = (*particles_)[index];
+      geom::Particle particle{};
       particle.position = { i * radius * 2.f, 0, baseHeight - j * radius * 2.f};
       particle.velocity = { 0.f, 0.f, 0.f };
       particle.mass = mass;
       particle.color = { 0.5f, 0.5f, v };
+      particles_->set(index, particle);
     }
   }
 
@@ -161,9 +162,9 @@ void SceneParticles::updateParticles(float dt)
   prevPositions_.resize(n);
   for (int i = 0; i < n; i++)
   {
-    prevPositions_[i] = particles[i].position;
-    particles[i].velocity += dt * gravity;
-    particles[i].position += dt * particles[i].velocity;
+    prevPositions_[i] = particles.position(i);
+    particles.velocity(i) += dt * gravity;
+    particles.setPosition(i, particles.position(i) + dt * particles.velocity(i));
   }
 
   particlesGeometry_->update(particles);
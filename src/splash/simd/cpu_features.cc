@@ -0,0 +1,85 @@
+#include <splash/simd/cpu_features.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace splash
+{
+namespace simd
+{
+namespace
+{
+InstructionSet detectInstructionSet()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  int info[4];
+  __cpuid(info, 0);
+  const auto maxLeaf = info[0];
+
+  __cpuid(info, 1);
+  const bool sse41 = (info[2] & (1 << 19)) != 0;
+  const bool osxsave = (info[2] & (1 << 27)) != 0;
+  const bool avx = (info[2] & (1 << 28)) != 0;
+  if (!sse41)
+    return InstructionSet::SCALAR;
+
+  // The operating system saves ymm and zmm registers on context switches
+  const auto xcr0 = osxsave ? _xgetbv(0) : 0;
+  const bool ymmState = (xcr0 & 0x6) == 0x6;
+  const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+  if (!avx || !ymmState || maxLeaf < 7)
+    return InstructionSet::SSE41;
+
+  __cpuidex(info, 7, 0);
+  const bool avx2 = (info[1] & (1 << 5)) != 0;
+  const bool avx512f = (info[1] & (1 << 16)) != 0;
+  if (avx512f && avx2 && zmmState)
+    return InstructionSet::AVX512;
+  if (avx2)
+    return InstructionSet::AVX2;
+  return InstructionSet::SSE41;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+  // Also checks that the operating system saves the wider registers
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2"))
+    return InstructionSet::AVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return InstructionSet::AVX2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return InstructionSet::SSE41;
+  return InstructionSet::SCALAR;
+#else
+  return InstructionSet::SCALAR;
+#endif
+}
+}
+
+InstructionSet supportedInstructionSet()
+{
+  static const auto instructionSet = detectInstructionSet();
+  return instructionSet;
+}
+
+bool isSupported(InstructionSet instructionSet)
+{
+  return static_cast<uint32_t>(instructionSet) <= static_cast<uint32_t>(supportedInstructionSet());
+}
+
+const char* instructionSetName(InstructionSet instructionSet)
+{
+  switch (instructionSet)
+  {
+  case InstructionSet::SSE41:
+    return "SSE4.1";
+  case InstructionSet::AVX2:
+    return "AVX2";
+  case InstructionSet::AVX512:
+    return "AVX-512";
+  default:
+    return "Scalar";
+  }
+}
+}
+}
@@ -0,0 +1,223 @@
+#include <splash/simd/distance_filter.h>
+
+#include <array>
+#include <cmath>
+
+#include <splash/simd/target.h>
+
+namespace splash
+{
+namespace simd
+{
+namespace
+{
+#ifdef SPLASH_SIMD_X86
+// Lane permutations moving the lanes set in an 8-bit mask to the front, in order
+const std::array<std::array<uint32_t, 8>, 256>& compressPermutations()
+{
+  static const auto permutations = []
+  {
+    std::array<std::array<uint32_t, 8>, 256> permutations{};
+    for (uint32_t mask = 0; mask < 256; mask++)
+    {
+      uint32_t count = 0;
+      for (uint32_t lane = 0; lane < 8; lane++)
+      {
+        if (mask & (1u << lane))
+          permutations[mask][count++] = lane;
+      }
+    }
+    return permutations;
+  }();
+  return permutations;
+}
+
+// Displacements to the nearest periodic image, with a zero extent along non-periodic axes
+SPLASH_SIMD_TARGET("sse4.1")
+inline __m128 minimumImage(__m128 d, float extent, float invExtent)
+{
+  const auto rounded = _mm_round_ps(_mm_mul_ps(d, _mm_set1_ps(invExtent)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  return _mm_sub_ps(d, _mm_mul_ps(_mm_set1_ps(extent), rounded));
+}
+
+SPLASH_SIMD_TARGET("avx2")
+inline __m256 minimumImage(__m256 d, float extent, float invExtent)
+{
+  const auto rounded = _mm256_round_ps(_mm256_mul_ps(d, _mm256_set1_ps(invExtent)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  return _mm256_sub_ps(d, _mm256_mul_ps(_mm256_set1_ps(extent), rounded));
+}
+
+SPLASH_SIMD_TARGET("avx512f")
+inline __m512 minimumImage(__m512 d, float extent, float invExtent)
+{
+  const auto rounded = _mm512_roundscale_ps(_mm512_mul_ps(d, _mm512_set1_ps(invExtent)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  return _mm512_sub_ps(d, _mm512_mul_ps(_mm512_set1_ps(extent), rounded));
+}
+#endif
+
+template <bool periodic>
+uint32_t filterScalar(float radiusSquared, const glm::vec3& extent, const glm::vec3& invExtent,
+  const glm::vec3& center, const float* x, const float* y, const float* z, const uint32_t* indices, uint32_t count, uint32_t* out)
+{
+  uint32_t n = 0;
+  for (uint32_t k = 0; k < count; k++)
+  {
+    auto d = center - glm::vec3(x[k], y[k], z[k]);
+    if (periodic)
+      d -= extent * glm::round(d * invExtent);
+
+    // Branch-free compaction, overwriting the slot after the survivors
+    out[n] = indices[k];
+    n += glm::dot(d, d) <= radiusSquared;
+  }
+  return n;
+}
+
+#ifdef SPLASH_SIMD_X86
+template <bool periodic>
+SPLASH_SIMD_TARGET("sse4.1")
+uint32_t filterSse41(float radiusSquared, const glm::vec3& extent, const glm::vec3& invExtent,
+  const glm::vec3& center, const float* x, const float* y, const float* z, const uint32_t* indices, uint32_t count, uint32_t* out)
+{
+  const auto cx = _mm_set1_ps(center.x);
+  const auto cy = _mm_set1_ps(center.y);
+  const auto cz = _mm_set1_ps(center.z);
+  const auto r2 = _mm_set1_ps(radiusSquared);
+
+  uint32_t n = 0;
+  uint32_t k = 0;
+  for (; k + 4 <= count; k += 4)
+  {
+    auto dx = _mm_sub_ps(cx, _mm_loadu_ps(x + k));
+    auto dy = _mm_sub_ps(cy, _mm_loadu_ps(y + k));
+    auto dz = _mm_sub_ps(cz, _mm_loadu_ps(z + k));
+    if (periodic)
+    {
+      dx = minimumImage(dx, extent.x, invExtent.x);
+      dy = minimumImage(dy, extent.y, invExtent.y);
+      dz = minimumImage(dz, extent.z, invExtent.z);
+    }
+
+    const auto d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    const auto mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+    for (int lane = 0; lane < 4; lane++)
+    {
+      out[n] = indices[k + lane];
+      n += (mask >> lane) & 1;
+    }
+  }
+
+  return n + filterScalar<periodic>(radiusSquared, extent, invExtent, center, x + k, y + k, z + k, indices + k, count - k, out + n);
+}
+
+template <bool periodic>
+SPLASH_SIMD_TARGET("avx2,popcnt")
+uint32_t filterAvx2(float radiusSquared, const glm::vec3& extent, const glm::vec3& invExtent,
+  const glm::vec3& center, const float* x, const float* y, const float* z, const uint32_t* indices, uint32_t count, uint32_t* out)
+{
+  const auto& permutations = compressPermutations();
+  const auto cx = _mm256_set1_ps(center.x);
+  const auto cy = _mm256_set1_ps(center.y);
+  const auto cz = _mm256_set1_ps(center.z);
+  const auto r2 = _mm256_set1_ps(radiusSquared);
+
+  uint32_t n = 0;
+  uint32_t k = 0;
+  for (; k + 8 <= count; k += 8)
+  {
+    auto dx = _mm256_sub_ps(cx, _mm256_loadu_ps(x + k));
+    auto dy = _mm256_sub_ps(cy, _mm256_loadu_ps(y + k));
+    auto dz = _mm256_sub_ps(cz, _mm256_loadu_ps(z + k));
+    if (periodic)
+    {
+      dx = minimumImage(dx, extent.x, invExtent.x);
+      dy = minimumImage(dy, extent.y, invExtent.y);
+      dz = minimumImage(dz, extent.z, invExtent.z);
+    }
+
+    // Survivors are permuted to the front and all 8 lanes stored, the lanes after them overwritten later
+    const auto d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    const auto mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ)));
+    const auto permutation = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(permutations[mask].data()));
+    const auto candidates = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices + k));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + n), _mm256_permutevar8x32_epi32(candidates, permutation));
+    n += _mm_popcnt_u32(mask);
+  }
+
+  return n + filterScalar<periodic>(radiusSquared, extent, invExtent, center, x + k, y + k, z + k, indices + k, count - k, out + n);
+}
+
+template <bool periodic>
+SPLASH_SIMD_TARGET("avx512f,popcnt")
+uint32_t filterAvx512(float radiusSquared, const glm::vec3& extent, const glm::vec3& invExtent,
+  const glm::vec3& center, const float* x, const float* y, const float* z, const uint32_t* indices, uint32_t count, uint32_t* out)
+{
+  const auto cx = _mm512_set1_ps(center.x);
+  const auto cy = _mm512_set1_ps(center.y);
+  const auto cz = _mm512_set1_ps(center.z);
+  const auto r2 = _mm512_set1_ps(radiusSquared);
+
+  uint32_t n = 0;
+  uint32_t k = 0;
+  for (; k + 16 <= count; k += 16)
+  {
+    auto dx = _mm512_sub_ps(cx, _mm512_loadu_ps(x + k));
+    auto dy = _mm512_sub_ps(cy, _mm512_loadu_ps(y + k));
+    auto dz = _mm512_sub_ps(cz, _mm512_loadu_ps(z + k));
+    if (periodic)
+    {
+      dx = minimumImage(dx, extent.x, invExtent.x);
+      dy = minimumImage(dy, extent.y, invExtent.y);
+      dz = minimumImage(dz, extent.z, invExtent.z);
+    }
+
+    // Masked compress store of the survivors only
+    const auto d2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+    const auto mask = _mm512_cmp_ps_mask(d2, r2, _CMP_LE_OQ);
+    _mm512_mask_compressstoreu_epi32(out + n, mask, _mm512_loadu_si512(indices + k));
+    n += _mm_popcnt_u32(mask);
+  }
+
+  // Remaining candidates 8 at a time
+  return n + filterAvx2<periodic>(radiusSquared, extent, invExtent, center, x + k, y + k, z + k, indices + k, count - k, out + n);
+}
+#endif
+}
+
+DistanceFilter::DistanceFilter(float radius, const glm::vec3& periodicExtent)
+  : DistanceFilter(radius, periodicExtent, supportedInstructionSet())
+{
+}
+
+DistanceFilter::DistanceFilter(float radius, const glm::vec3& periodicExtent, InstructionSet instructionSet)
+  : instructionSet_(isSupported(instructionSet) ? instructionSet : supportedInstructionSet())
+  , radiusSquared_(radius * radius)
+  , extent_(periodicExtent)
+{
+  for (int axis = 0; axis < 3; axis++)
+    invExtent_[axis] = extent_[axis] != 0.f ? 1.f / extent_[axis] : 0.f;
+  const auto periodic = extent_ != glm::vec3(0.f);
+
+  switch (instructionSet_)
+  {
+#ifdef SPLASH_SIMD_X86
+  case InstructionSet::AVX512:
+    compressPermutations();
+    filter_ = periodic ? filterAvx512<true> : filterAvx512<false>;
+    break;
+  case InstructionSet::AVX2:
+    compressPermutations();
+    filter_ = periodic ? filterAvx2<true> : filterAvx2<false>;
+    break;
+  case InstructionSet::SSE41:
+    filter_ = periodic ? filterSse41<true> : filterSse41<false>;
+    break;
+#endif
+  default:
+    instructionSet_ = InstructionSet::SCALAR;
+    filter_ = periodic ? filterScalar<true> : filterScalar<false>;
+    break;
+  }
+}
+}
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <splash/simd/cpu_features.h>
+#include <splash/simd/distance_filter.h>
+
+namespace
+{
+using namespace splash;
+
+struct Candidates
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<uint32_t> indices;
+
+  void add(const glm::vec3& p)
+  {
+    indices.push_back(x.size());
+    x.push_back(p.x);
+    y.push_back(p.y);
+    z.push_back(p.z);
+  }
+};
+
+// Random candidates around the center, candidates within rounding of the radius,
+// and candidates at exactly the radius in exactly representable coordinates
+Candidates createCandidates(std::mt19937& gen, const glm::vec3& center, float radius, int count)
+{
+  std::uniform_real_distribution<float> distribution(-2.f * radius, 2.f * radius);
+  std::uniform_real_distribution<float> nearRadius(1.f - 1e-6f, 1.f + 1e-6f);
+  std::uniform_int_distribution<int> kind(0, 3);
+
+  Candidates candidates;
+  for (int i = 0; i < count; i++)
+  {
+    switch (kind(gen))
+    {
+    case 0:
+      candidates.add(center + glm::vec3(0.375f, 0.5f, 0.f));
+      break;
+    case 1:
+      candidates.add(center - glm::vec3(0.f, 0.f, radius));
+      break;
+    case 2:
+    {
+      // Within rounding of the radius, where the order of operations decides
+      const auto direction = glm::normalize(glm::vec3(distribution(gen), distribution(gen), distribution(gen)) + glm::vec3(1e-3f));
+      candidates.add(center + direction * radius * nearRadius(gen));
+      break;
+    }
+    default:
+      candidates.add(center + glm::vec3(distribution(gen), distribution(gen), distribution(gen)));
+      break;
+    }
+  }
+  return candidates;
+}
+}
+
+// Checks that every supported instruction set selects the same candidates as the scalar filter,
+// for candidate counts covering full vectors and remainders of each width, with and without periodic axes
+int main()
+{
+  const std::vector<simd::InstructionSet> instructionSets{
+    simd::InstructionSet::SSE41,
+    simd::InstructionSet::AVX2,
+    simd::InstructionSet::AVX512,
+  };
+
+  constexpr float radius = 0.625f;
+  const glm::vec3 center(0.25f, -0.5f, 1.f);
+  const std::vector<glm::vec3> extents{ glm::vec3(0.f), glm::vec3(1.5f, 0.f, 2.f) };
+
+  std::mt19937 gen(0);
+  bool passed = true;
+  for (const auto& extent : extents)
+  {
+    const simd::DistanceFilter reference(radius, extent, simd::InstructionSet::SCALAR);
+
+    for (auto instructionSet : instructionSets)
+    {
+      if (!simd::isSupported(instructionSet))
+      {
+        std::cout << simd::instructionSetName(instructionSet) << " not supported" << std::endl;
+        continue;
+      }
+
+      const simd::DistanceFilter filter(radius, extent, instructionSet);
+
+      uint64_t tests = 0;
+      uint64_t mismatches = 0;
+      for (int count = 0; count <= 70; count++)
+      {
+        for (int repeat = 0; repeat < 20; repeat++)
+        {
+          const auto candidates = createCandidates(gen, center, radius, count);
+
+          std::vector<uint32_t> expected(count + simd::DistanceFilter::padding);
+          std::vector<uint32_t> actual(count + simd::DistanceFilter::padding);
+          const auto expectedCount = reference(center, candidates.x.data(), candidates.y.data(), candidates.z.data(), candidates.indices.data(), count, expected.data());
+          const auto actualCount = filter(center, candidates.x.data(), candidates.y.data(), candidates.z.data(), candidates.indices.data(), count, actual.data());
+
+          tests++;
+          if (actualCount != expectedCount || !std::equal(expected.begin(), expected.begin() + expectedCount, actual.begin()))
+            mismatches++;
+        }
+      }
+
+      std::cout << simd::instructionSetName(filter.instructionSet())
+        << (extent == glm::vec3(0.f) ? "" : ", periodic") << ": "
+        << tests << " tests, " << mismatches << " mismatches" << std::endl;
+      passed = passed && mismatches == 0;
+    }
+  }
+
+  std::cout << (passed ? "All instruction sets match the scalar filter" : "Distance filter validation failed") << std::endl;
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+#include <iostream>
+
+#include <splash/fluid/neighbor_search_validation.h>
+
+// Checks all neighbor searches against the brute force reference
+int main()
+{
+  splash::fluid::NeighborSearchValidation validation;
+  validation.validateAll();
+  validation.printReport(std::cout);
+  return validation.passed() ? 0 : 1;
+}
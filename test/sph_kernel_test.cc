@@ -0,0 +1,150 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <splash/fluid/sph_kernel.h>
+#include <splash/simd/cpu_features.h>
+
+namespace
+{
+using namespace splash;
+
+// Kernel without batch overrides, evaluated by the scalar loops of SphKernel
+class SphKernelScalar final : public fluid::SphKernel
+{
+public:
+  SphKernelScalar(float h)
+    : fluid::SphKernel(h)
+    , kernel_(h)
+  {
+  }
+
+  float operator () (const glm::vec3& r) const override { return kernel_(r); }
+  glm::vec3 grad(const glm::vec3& r) const override { return kernel_.grad(r); }
+
+private:
+  fluid::SphKernelPoly6 kernel_;
+};
+
+struct Displacements
+{
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  void add(const glm::vec3& d)
+  {
+    x.push_back(d.x);
+    y.push_back(d.y);
+    z.push_back(d.z);
+  }
+};
+
+// Random displacements within and beyond h, zero displacements, and displacements of exactly h = 0.625
+Displacements createDisplacements(std::mt19937& gen, float h, int count)
+{
+  std::uniform_real_distribution<float> distribution(-1.2f * h, 1.2f * h);
+  std::uniform_int_distribution<int> kind(0, 5);
+
+  Displacements displacements;
+  for (int i = 0; i < count; i++)
+  {
+    switch (kind(gen))
+    {
+    case 0:
+      displacements.add(glm::vec3(0.f));
+      break;
+    case 1:
+      displacements.add(glm::vec3(0.375f, 0.f, -0.5f));
+      break;
+    default:
+      displacements.add({ distribution(gen), distribution(gen), distribution(gen) });
+      break;
+    }
+  }
+  return displacements;
+}
+
+bool same(float a, float b)
+{
+  return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+}
+
+// Checks that batch evaluation of each kernel type gives the same values and gradients as its scalar functions,
+// bit for bit, with every supported instruction set, for counts covering full vectors and remainders of each width
+int main()
+{
+  constexpr float h = 0.625f; // Exactly the length of (0.375, 0, -0.5)
+
+  std::vector<std::pair<std::string, std::unique_ptr<fluid::SphKernel>>> kernels;
+  kernels.emplace_back("Poly6", std::make_unique<fluid::SphKernelPoly6>(h));
+  kernels.emplace_back("Spiky", std::make_unique<fluid::SphKernelSpiky>(h));
+  kernels.emplace_back("Scalar", std::make_unique<SphKernelScalar>(h));
+
+  const std::vector<simd::InstructionSet> instructionSets{
+    simd::InstructionSet::SCALAR,
+    simd::InstructionSet::SSE41,
+    simd::InstructionSet::AVX2,
+    simd::InstructionSet::AVX512,
+  };
+
+  std::mt19937 gen(0);
+  bool passed = true;
+  for (auto& kernel : kernels)
+  {
+    for (auto instructionSet : instructionSets)
+    {
+      if (!simd::isSupported(instructionSet))
+      {
+        std::cout << simd::instructionSetName(instructionSet) << " not supported" << std::endl;
+        continue;
+      }
+
+      auto& sphKernel = *kernel.second;
+      sphKernel.setInstructionSet(instructionSet);
+
+      uint64_t values = 0;
+      uint64_t mismatches = 0;
+      for (int count = 0; count <= 40; count++)
+      {
+        for (int repeat = 0; repeat < 20; repeat++)
+        {
+          const auto d = createDisplacements(gen, h, count);
+
+          std::vector<float> w(count);
+          std::vector<float> gx(count);
+          std::vector<float> gy(count);
+          std::vector<float> gz(count);
+          sphKernel.evaluate(d.x.data(), d.y.data(), d.z.data(), count, w.data());
+          sphKernel.evaluateGrad(d.x.data(), d.y.data(), d.z.data(), count, gx.data(), gy.data(), gz.data());
+
+          for (int k = 0; k < count; k++)
+          {
+            const glm::vec3 r(d.x[k], d.y[k], d.z[k]);
+            const auto expectedW = sphKernel(r);
+            const auto expectedGrad = sphKernel.grad(r);
+
+            values++;
+            if (!same(w[k], expectedW) || !same(gx[k], expectedGrad.x) || !same(gy[k], expectedGrad.y) || !same(gz[k], expectedGrad.z))
+              mismatches++;
+          }
+        }
+      }
+
+      std::cout << kernel.first << ", " << simd::instructionSetName(sphKernel.instructionSet()) << ": "
+        << values << " values, " << mismatches << " mismatches" << std::endl;
+      passed = passed && mismatches == 0;
+    }
+  }
+
+  std::cout << (passed ? "All kernel batches match the scalar kernels" : "Kernel batch validation failed") << std::endl;
+  return passed ? 0 : 1;
+}
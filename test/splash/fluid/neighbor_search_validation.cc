@@ -0,0 +1,526 @@
+#include <splash/fluid/neighbor_search_validation.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <numeric>
+#include <random>
+
+#include <glm/glm.hpp>
+
+#include <splash/fluid/neighbor_search_bvh.h>
+#include <splash/fluid/neighbor_search_multi_level_grid.h>
+#include <splash/fluid/neighbor_search_naive.h>
+#include <splash/fluid/neighbor_search_sparse_grid.h>
+#include <splash/fluid/neighbor_search_spatial_hashing.h>
+#include <splash/fluid/neighbor_search_uniform_grid.h>
+
+namespace splash
+{
+namespace fluid
+{
+namespace
+{
+geom::Particles createParticles(const std::vector<glm::vec3>& positions)
+{
+  geom::Particles particles(positions.size());
+  for (int i = 0; i < positions.size(); i++)
+  {
+    particles.setPosition(i, positions[i]);
+    particles.type(i) = geom::ParticleType::FLUID;
+  }
+  return particles;
+}
+
+// Sorted neighbor indices of each particle, with both directions of symmetric pairs
+std::vector<std::vector<uint32_t>> expandNeighbors(const NeighborList& neighbors)
+{
+  const auto n = neighbors.particleCount();
+
+  std::vector<std::vector<uint32_t>> result(n);
+  for (int i = 0; i < n; i++)
+  {
+    for (auto j : neighbors[i])
+    {
+      result[i].push_back(j);
+      if (neighbors.symmetric())
+        result[j].push_back(i);
+    }
+  }
+
+  for (auto& indices : result)
+    std::sort(indices.begin(), indices.end());
+
+  return result;
+}
+
+// Multiset differences of sorted indices
+void compareIndices(const std::vector<uint32_t>& expected, const std::vector<uint32_t>& actual, NeighborSearchValidation::Result& result)
+{
+  result.expectedPairs += expected.size();
+
+  std::vector<uint32_t> difference;
+  std::set_difference(expected.begin(), expected.end(), actual.begin(), actual.end(), std::back_inserter(difference));
+  result.missingPairs += difference.size();
+
+  difference.clear();
+  std::set_difference(actual.begin(), actual.end(), expected.begin(), expected.end(), std::back_inserter(difference));
+  result.extraPairs += difference.size();
+}
+}
+
+NeighborSearchValidation::NeighborSearchValidation()
+{
+  createParticleSets();
+}
+
+NeighborSearchValidation::~NeighborSearchValidation() = default;
+
+void NeighborSearchValidation::createParticleSets()
+{
+  std::mt19937 gen(0);
+
+  // Uniformly random
+  {
+    std::uniform_real_distribution<float> distribution(0.f, 4.f);
+    std::vector<glm::vec3> positions(4000);
+    for (auto& p : positions)
+      p = { distribution(gen), distribution(gen), distribution(gen) };
+    particleSets_.push_back({ "uniform", createParticles(positions), 0.3f });
+  }
+
+  // Negative coordinates, straddling the origin where truncation and flooring of cell coordinates differ
+  {
+    std::uniform_real_distribution<float> distribution(-2.f, 2.f);
+    std::vector<glm::vec3> positions(4000);
+    for (auto& p : positions)
+      p = { distribution(gen), distribution(gen), distribution(gen) - 3.f };
+    particleSets_.push_back({ "negative", createParticles(positions), 0.3f });
+  }
+
+  // Dense clusters much smaller than h, and sparse outliers
+  {
+    std::uniform_real_distribution<float> uniform(-3.f, 3.f);
+    std::normal_distribution<float> normal(0.f, 0.05f);
+    std::vector<glm::vec3> positions;
+    for (int cluster = 0; cluster < 5; cluster++)
+    {
+      const glm::vec3 center(uniform(gen), uniform(gen), uniform(gen));
+      for (int i = 0; i < 600; i++)
+        positions.push_back(center + glm::vec3(normal(gen), normal(gen), normal(gen)));
+    }
+    for (int i = 0; i < 200; i++)
+      positions.push_back({ uniform(gen), uniform(gen), uniform(gen) });
+    particleSets_.push_back({ "clustered", createParticles(positions), 0.3f });
+  }
+
+  // Lattice with spacing exactly h, and Pythagorean offsets at exactly h, in exactly representable coordinates
+  {
+    constexpr float h = 0.625f;
+    std::vector<glm::vec3> positions;
+    for (int i = -6; i < 6; i++)
+    {
+      for (int j = -6; j < 6; j++)
+      {
+        for (int k = -6; k < 6; k++)
+        {
+          const auto p = glm::vec3(i, j, k) * h;
+          positions.push_back(p);
+          if ((i + j + k) % 3 == 0)
+            positions.push_back(p + glm::vec3(0.375f, 0.5f, 0.f));
+        }
+      }
+    }
+    particleSets_.push_back({ "exact distance", createParticles(positions), h });
+  }
+
+  // Coincident particles
+  {
+    std::uniform_int_distribution<int> distribution(0, 7);
+    std::vector<glm::vec3> positions(1000);
+    for (auto& p : positions)
+      p = glm::vec3(distribution(gen), distribution(gen), distribution(gen)) * 0.25f;
+    particleSets_.push_back({ "coincident", createParticles(positions), 0.25f });
+  }
+
+  // Two distant clusters, with a bounding box of far more cells than particles
+  {
+    std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    std::vector<glm::vec3> positions(2000);
+    for (int i = 0; i < positions.size(); i++)
+    {
+      const auto offset = i % 2 == 0 ? glm::vec3(-1000.f) : glm::vec3(1000.f, 500.f, 100.f);
+      positions[i] = offset + glm::vec3(distribution(gen), distribution(gen), distribution(gen));
+    }
+    particleSets_.push_back({ "distant clusters", createParticles(positions), 0.1f });
+  }
+
+  // Radii of several resolution levels, and in between levels
+  {
+    std::uniform_real_distribution<float> distribution(0.f, 4.f);
+    const std::vector<float> levels{ 0.1f, 0.15f, 0.2f, 0.4f, 0.8f };
+    std::uniform_int_distribution<int> level(0, levels.size() - 1);
+    std::vector<glm::vec3> positions(3000);
+    std::vector<float> radii(positions.size());
+    for (int i = 0; i < positions.size(); i++)
+    {
+      positions[i] = { distribution(gen), distribution(gen), distribution(gen) };
+      radii[i] = i % 10 == 0 ? levels[level(gen)] : levels[0];
+    }
+    particleSets_.push_back({ "multi-resolution", createParticles(positions), 0.f, radii });
+  }
+
+  // Fluid in a box of boundary particles, with and without boundary neighbors
+  {
+    std::uniform_real_distribution<float> distribution(0.05f, 1.95f);
+    std::vector<glm::vec3> positions(2000);
+    for (auto& p : positions)
+      p = { distribution(gen), distribution(gen), distribution(gen) };
+
+    const auto fluidCount = positions.size();
+    for (int i = 0; i <= 20; i++)
+    {
+      for (int j = 0; j <= 20; j++)
+      {
+        const auto a = i * 0.1f;
+        const auto b = j * 0.1f;
+        positions.insert(positions.end(), { { a, b, 0.f }, { a, b, 2.f }, { a, 0.f, b }, { a, 2.f, b }, { 0.f, a, b }, { 2.f, a, b } });
+      }
+    }
+
+    // Boundary particles interleaved with fluid particles
+    std::vector<uint32_t> order(positions.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), gen);
+    geom::Particles particles(positions.size());
+    for (int i = 0; i < particles.size(); i++)
+    {
+      particles.setPosition(i, positions[order[i]]);
+      particles.type(i) = order[i] < fluidCount ? geom::ParticleType::FLUID : geom::ParticleType::BOUNDARY;
+    }
+
+    particleSets_.push_back({ "boundary", particles, 0.25f });
+    particleSets_.push_back({ "boundary, fluid", particles, 0.25f, {}, false });
+  }
+
+  // Periodic along x and y, with pairs across the domain faces
+  {
+    std::uniform_real_distribution<float> distribution(0.f, 3.f);
+    std::vector<glm::vec3> positions(4000);
+    for (auto& p : positions)
+      p = { distribution(gen), distribution(gen), distribution(gen) };
+    const PeriodicDomain domain({ true, true, false }, glm::vec3(0.f), glm::vec3(3.f));
+    particleSets_.push_back({ "periodic", createParticles(positions), 0.3f, {}, true, domain });
+  }
+
+  // Periodic along x with only 2 cells, so that cells at offsets -1 and 1 are the same
+  {
+    std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    std::vector<glm::vec3> positions(2000);
+    for (auto& p : positions)
+      p = { 0.7f * distribution(gen), 3.f * distribution(gen), 3.f * distribution(gen) };
+    const PeriodicDomain domain({ true, false, false }, glm::vec3(0.f), glm::vec3(0.7f, 3.f, 3.f));
+    particleSets_.push_back({ "periodic, 2 cells", createParticles(positions), 0.3f, {}, true, domain });
+  }
+}
+
+void NeighborSearchValidation::validateAll()
+{
+  NeighborSearchSpatialHashing spatialHashing;
+  validate(spatialHashing, "Spatial hashing");
+
+  NeighborSearchUniformGrid uniformGrid;
+  validate(uniformGrid, "Uniform grid");
+
+  NeighborSearchBvh bvh;
+  validate(bvh, "BVH");
+
+  NeighborSearchMultiLevelGrid multiLevelGrid;
+  validate(multiLevelGrid, "Multi-level grid");
+
+  NeighborSearchSparseGrid sparseGrid;
+  validate(sparseGrid, "Sparse grid");
+}
+
+void NeighborSearchValidation::validate(NeighborSearch& neighborSearch, const std::string& name)
+{
+  NeighborSearchNaive reference;
+  reference.setMultiprocessing(true);
+
+  for (const auto& particleSet : particleSets_)
+  {
+    if (particleSet.domain.enabled() && !neighborSearch.supportsPeriodicDomain())
+      continue;
+
+    reference.setPeriodicDomain(particleSet.domain);
+    neighborSearch.setPeriodicDomain(particleSet.domain);
+
+    const auto search = [&](NeighborSearch& neighborSearch)
+    {
+      if (particleSet.radii.empty())
+        neighborSearch.computeNeighbors(particleSet.particles, particleSet.h);
+      else
+        neighborSearch.computeVariableNeighbors(particleSet.particles, particleSet.radii);
+    };
+
+    const auto& particles = particleSet.particles;
+    const auto isBoundary = [&](uint32_t i) { return particles.type(i) == geom::ParticleType::BOUNDARY; };
+
+    reference.setBoundaryNeighbors(true);
+    search(reference);
+    auto expected = expandNeighbors(reference.neighbors());
+
+    // Without boundary neighbors, boundary-boundary pairs are dropped
+    if (!particleSet.boundaryNeighbors)
+    {
+      for (int i = 0; i < expected.size(); i++)
+      {
+        if (isBoundary(i))
+          expected[i].erase(std::remove_if(expected[i].begin(), expected[i].end(), isBoundary), expected[i].end());
+      }
+    }
+
+    // Unordered pairs, each in the expected neighbors of both particles
+    const auto expectedPairCount = std::accumulate(expected.begin(), expected.end(), uint64_t(0),
+      [](uint64_t count, const std::vector<uint32_t>& indices) { return count + indices.size(); }) / 2;
+
+    for (int mode = 0; mode < 4; mode++)
+    {
+      Result result;
+      result.neighborSearch = name;
+      result.particleSet = particleSet.name;
+      result.symmetric = mode & 1;
+      result.multiprocessing = mode & 2;
+
+      neighborSearch.setSymmetric(result.symmetric);
+      neighborSearch.setMultiprocessing(result.multiprocessing);
+      neighborSearch.setBoundaryNeighbors(particleSet.boundaryNeighbors);
+      neighborSearch.setStatisticsEnabled(true);
+      search(neighborSearch);
+      const auto& neighbors = neighborSearch.neighbors();
+      const auto actual = expandNeighbors(neighbors);
+      result.pairCountMatches = neighborSearch.statistics().pairCount == expectedPairCount;
+
+      for (int i = 0; i < expected.size(); i++)
+      {
+        // Boundary particles are not queried in full lists without boundary neighbors
+        const std::vector<uint32_t> empty;
+        const auto queried = particleSet.boundaryNeighbors || result.symmetric || !isBoundary(i);
+        const auto& expectedNeighbors = queried ? expected[i] : empty;
+
+        compareIndices(expectedNeighbors, i < actual.size() ? actual[i] : empty, result);
+
+        // Fluid neighbors first, then boundary neighbors
+        if (i < neighbors.particleCount())
+        {
+          for (auto j : neighbors.fluid(i))
+            result.extraPairs += isBoundary(j);
+          for (auto j : neighbors.boundary(i))
+            result.extraPairs += !isBoundary(j);
+        }
+      }
+
+      results_.push_back(result);
+    }
+
+    if (particleSet.radii.empty() && particleSet.boundaryNeighbors)
+      validateQueries(neighborSearch, name, particleSet);
+  }
+
+  validateFrames(neighborSearch, name);
+
+  neighborSearch.setSymmetric(false);
+  neighborSearch.setMultiprocessing(false);
+  neighborSearch.setBoundaryNeighbors(true);
+  neighborSearch.setStatisticsEnabled(false);
+  neighborSearch.setPeriodicDomain(PeriodicDomain());
+  neighborSearch.invalidate();
+}
+
+void NeighborSearchValidation::validateQueries(NeighborSearch& neighborSearch, const std::string& name, const ParticleSet& particleSet)
+{
+  const auto h = particleSet.h;
+  auto particles = particleSet.particles;
+  const auto n = particles.size();
+
+  neighborSearch.setSymmetric(false);
+  neighborSearch.setMultiprocessing(true);
+  neighborSearch.setBoundaryNeighbors(true);
+  neighborSearch.setSkin(0.5f * h);
+  neighborSearch.invalidate();
+  neighborSearch.updateNeighbors(particles, h);
+
+  // Moved by less than skin / 2, so that queries use the structure of the last build
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<float> offset(-0.1f * h, 0.1f * h);
+  for (int i = 0; i < n; i++)
+    particles.setPosition(i, particles.position(i) + glm::vec3(offset(gen), offset(gen), offset(gen)));
+  neighborSearch.updateNeighbors(particles, h);
+
+  // At particles, and around them
+  std::vector<glm::vec3> points;
+  for (int i = 0; i < n; i += 10)
+  {
+    points.push_back(particles.position(i));
+    points.push_back(particles.position(i) + 10.f * glm::vec3(offset(gen), offset(gen), offset(gen)));
+  }
+
+  const auto distance2 = [&](const glm::vec3& point, uint32_t i)
+  {
+    const auto d = particleSet.domain.displacement(point, particles.position(i));
+    return glm::dot(d, d);
+  };
+
+  std::vector<std::vector<uint32_t>> actual;
+  std::vector<uint32_t> expected;
+
+  Result radiusResult;
+  radiusResult.neighborSearch = name;
+  radiusResult.particleSet = particleSet.name + ", radius";
+  radiusResult.multiprocessing = true;
+
+  neighborSearch.queryRadius(particles, points, h, actual);
+  for (int q = 0; q < points.size(); q++)
+  {
+    expected.clear();
+    for (uint32_t i = 0; i < n; i++)
+    {
+      if (distance2(points[q], i) <= h * h)
+        expected.push_back(i);
+    }
+
+    std::sort(actual[q].begin(), actual[q].end());
+    compareIndices(expected, actual[q], radiusResult);
+  }
+  results_.push_back(radiusResult);
+
+  // Nearest particles are compared by distance, as particles at equal distance may be taken in any order
+  constexpr int k = 8;
+  Result nearestResult;
+  nearestResult.neighborSearch = name;
+  nearestResult.particleSet = particleSet.name + ", nearest";
+  nearestResult.multiprocessing = true;
+
+  neighborSearch.queryNearest(particles, points, k, actual);
+  std::vector<float> expectedDistances(n);
+  for (int q = 0; q < points.size(); q++)
+  {
+    for (uint32_t i = 0; i < n; i++)
+      expectedDistances[i] = distance2(points[q], i);
+
+    const auto count = std::min<size_t>(k, n);
+    std::partial_sort(expectedDistances.begin(), expectedDistances.begin() + count, expectedDistances.end());
+    nearestResult.expectedPairs += count;
+
+    for (int j = 0; j < count; j++)
+    {
+      if (j >= actual[q].size() || distance2(points[q], actual[q][j]) != expectedDistances[j])
+        nearestResult.missingPairs++;
+    }
+    if (actual[q].size() > count)
+      nearestResult.extraPairs += actual[q].size() - count;
+  }
+  results_.push_back(nearestResult);
+
+  neighborSearch.setSkin(0.f);
+  neighborSearch.invalidate();
+}
+
+void NeighborSearchValidation::validateFrames(NeighborSearch& neighborSearch, const std::string& name)
+{
+  constexpr float h = 0.3f;
+  constexpr float size = 4.f;
+
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<float> distribution(0.f, size);
+  std::vector<glm::vec3> positions(3000);
+  for (auto& p : positions)
+    p = { distribution(gen), distribution(gen), distribution(gen) };
+  auto particles = createParticles(positions);
+  const auto n = particles.size();
+
+  NeighborSearchNaive reference;
+  reference.setMultiprocessing(true);
+  neighborSearch.setBoundaryNeighbors(true);
+  neighborSearch.setPeriodicDomain(PeriodicDomain());
+  neighborSearch.invalidate();
+
+  // Particles moving across cells within the box, so that grids keep their layout and cell lists update in place
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  std::uniform_real_distribution<float> offset(-1.5f * h, 1.5f * h);
+  const auto move = [&](float fraction)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      if (unit(gen) < fraction)
+        particles.setPosition(i, glm::clamp(particles.position(i) + glm::vec3(offset(gen), offset(gen), offset(gen)), glm::vec3(0.f), glm::vec3(size)));
+    }
+  };
+
+  constexpr int frameCount = 8;
+  for (int frame = 0; frame < frameCount; frame++)
+  {
+    std::string description = "first frame";
+    if (frame == 3)
+    {
+      // More particles than the free slots of a cell, within a small fraction of particles
+      std::uniform_real_distribution<float> crowd(2.f, 2.f + 0.2f * h);
+      for (int i = 0; i < 40; i++)
+        particles.setPosition(i, { crowd(gen), crowd(gen), crowd(gen) });
+      description = "crowded cell";
+    }
+    else if (frame == 5)
+    {
+      // Above the fraction of particles changing cell for which cell lists are rebuilt
+      move(0.5f);
+      description = "most moved";
+    }
+    else if (frame > 0)
+    {
+      move(0.02f);
+      description = "few moved";
+    }
+
+    Result result;
+    result.neighborSearch = name;
+    result.particleSet = "frame " + std::to_string(frame) + ", " + description;
+    result.symmetric = frame & 1;
+    result.multiprocessing = frame & 2;
+
+    reference.computeNeighbors(particles, h);
+    const auto expected = expandNeighbors(reference.neighbors());
+
+    neighborSearch.setSymmetric(result.symmetric);
+    neighborSearch.setMultiprocessing(result.multiprocessing);
+    neighborSearch.computeNeighbors(particles, h);
+    const auto actual = expandNeighbors(neighborSearch.neighbors());
+
+    for (int i = 0; i < n; i++)
+      compareIndices(expected[i], i < actual.size() ? actual[i] : std::vector<uint32_t>(), result);
+    results_.push_back(result);
+  }
+}
+
+bool NeighborSearchValidation::passed() const
+{
+  return std::all_of(results_.begin(), results_.end(), [](const Result& result) { return result.passed(); });
+}
+
+void NeighborSearchValidation::printReport(std::ostream& out) const
+{
+  for (const auto& result : results_)
+  {
+    out << std::left << std::setw(18) << result.neighborSearch
+      << std::setw(28) << result.particleSet
+      << std::setw(11) << (result.symmetric ? "symmetric" : "full")
+      << std::setw(9) << (result.multiprocessing ? "parallel" : "serial")
+      << std::right << std::setw(10) << result.expectedPairs << " pairs, "
+      << result.missingPairs << " missing, "
+      << result.extraPairs << " extra"
+      << (result.pairCountMatches ? "" : ", wrong pair count")
+      << (result.passed() ? "" : "  FAILED") << std::endl;
+  }
+  out << (passed() ? "All neighbor searches match the reference" : "Neighbor search validation failed") << std::endl;
+}
+}
+}
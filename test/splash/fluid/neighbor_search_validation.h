@@ -0,0 +1,77 @@
+#ifndef SPLASH_FLUID_NEIGHBOR_SEARCH_VALIDATION_H_
+#define SPLASH_FLUID_NEIGHBOR_SEARCH_VALIDATION_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <splash/fluid/periodic_domain.h>
+#include <splash/geom/particles.h>
+
+namespace splash
+{
+namespace fluid
+{
+class NeighborSearch;
+
+// Compares neighbor searches pair for pair against NeighborSearchNaive,
+// on random and adversarial particle sets, in all symmetric and multiprocessing modes.
+// Particle sets with per-particle radii are searched with computeVariableNeighbors.
+// Boundary particles are compared with and without boundary neighbors, against the reference with them.
+// Pair counts of the search statistics are checked in all modes.
+// Periodic particle sets are validated on searches supporting periodic domains.
+// Radius and nearest neighbor queries are compared against brute force, after particles moved within the skin.
+// Searches are also compared over frames where some particles change cell, crowd into one cell, or mostly move at once.
+class NeighborSearchValidation
+{
+public:
+  struct Result
+  {
+    std::string neighborSearch;
+    std::string particleSet;
+    bool symmetric = false;
+    bool multiprocessing = false;
+    uint64_t expectedPairs = 0;
+    uint64_t missingPairs = 0;
+    uint64_t extraPairs = 0; // Including pairs reported twice, a particle with itself, or in the wrong partition
+    bool pairCountMatches = true; // Unordered pairs of the search statistics
+
+    bool passed() const noexcept { return missingPairs == 0 && extraPairs == 0 && pairCountMatches; }
+  };
+
+  NeighborSearchValidation();
+  ~NeighborSearchValidation();
+
+  // Validates all neighbor search implementations
+  void validateAll();
+
+  void validate(NeighborSearch& neighborSearch, const std::string& name);
+
+  const auto& results() const noexcept { return results_; }
+  bool passed() const;
+
+  void printReport(std::ostream& out) const;
+
+private:
+  struct ParticleSet
+  {
+    std::string name;
+    geom::Particles particles;
+    float h = 1.f;
+    std::vector<float> radii; // Per-particle radii if not empty, instead of h
+    bool boundaryNeighbors = true;
+    PeriodicDomain domain;
+  };
+
+  void createParticleSets();
+  void validateQueries(NeighborSearch& neighborSearch, const std::string& name, const ParticleSet& particleSet);
+  void validateFrames(NeighborSearch& neighborSearch, const std::string& name);
+
+  std::vector<ParticleSet> particleSets_;
+  std::vector<Result> results_;
+};
+}
+}
+
+#endif // SPLASH_FLUID_NEIGHBOR_SEARCH_VALIDATION_H_